@@ -0,0 +1,1203 @@
+#include "Dictionary.h"
+#include "RadixDictionary.h"
+#include "CompactDictionary.h"
+#include "FrozenDictionary.h"
+#include "StaticDictionary.h"
+#include "LockFreeDictionary.h"
+#include "BatchedWriter.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Micro-benchmarks for Dictionary. Run in Release; pass a substring to run
+// only the matching cases, and --counters to add hardware counters (Linux).
+// Results are written to stdout as one JSON document.
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Harness
+
+struct BenchmarkResult {
+    std::string name;
+    std::size_t operations;
+    double seconds;
+    std::vector<std::pair<std::string, double>> metrics; // Case-specific figures
+};
+
+// Keeps measured results observable so the optimiser cannot drop the work.
+static volatile std::size_t benchmarkSink;
+
+enum class PerfEvent {
+    Cycles,
+    Instructions,
+    L1dReadMisses,
+    LlcReadMisses,
+    DtlbReadMisses,
+    BranchMisses,
+};
+
+// One hardware event counted through perf_event_open (Linux only) for the
+// calling thread and any thread it starts while counting. Where the kernel,
+// a VM or the platform refuses, available() is false and the metric is
+// simply omitted from the results.
+class PerfCounter {
+public:
+    explicit PerfCounter(PerfEvent event)
+    {
+#if defined(__linux__)
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        switch (event) {
+        case PerfEvent::Cycles:
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfEvent::Instructions:
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfEvent::L1dReadMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cacheEvent(PERF_COUNT_HW_CACHE_L1D);
+            break;
+        case PerfEvent::LlcReadMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cacheEvent(PERF_COUNT_HW_CACHE_LL);
+            break;
+        case PerfEvent::DtlbReadMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = cacheEvent(PERF_COUNT_HW_CACHE_DTLB);
+            break;
+        case PerfEvent::BranchMisses:
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        }
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // Counters are multiplexed when there are more than the PMU holds;
+        // the enabled and running times let stop() scale the estimate.
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)event;
+#endif
+    }
+
+    ~PerfCounter()
+    {
+#if defined(__linux__)
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    bool available() const { return fd >= 0; }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    std::uint64_t stop()
+    {
+        std::uint64_t value = 0;
+#if defined(__linux__)
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            std::uint64_t data[3]; // Value, time enabled, time running
+            if (read(fd, data, sizeof(data)) == static_cast<ssize_t>(sizeof(data)) && data[2] != 0) {
+                value = static_cast<std::uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+            }
+        }
+#endif
+        return value;
+    }
+
+private:
+    int fd = -1;
+
+#if defined(__linux__)
+    static std::uint64_t cacheEvent(std::uint64_t cache)
+    {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+#endif
+};
+
+// Set by --counters: measure() then reports these events per operation.
+static bool collectCounters = false;
+
+static const std::pair<const char*, PerfEvent> counterEvents[] = {
+    { "cycles", PerfEvent::Cycles },
+    { "instructions", PerfEvent::Instructions },
+    { "l1d_misses", PerfEvent::L1dReadMisses },
+    { "llc_misses", PerfEvent::LlcReadMisses },
+    { "dtlb_misses", PerfEvent::DtlbReadMisses },
+    { "branch_misses", PerfEvent::BranchMisses },
+};
+
+// Time 'body', which is expected to perform 'operations' operations, and
+// with --counters count hardware events over the same interval.
+template <typename Body>
+BenchmarkResult measure(const std::string& name, std::size_t operations, Body body)
+{
+    std::vector<std::unique_ptr<PerfCounter>> counters;
+    if (collectCounters) {
+        for (const auto& event : counterEvents) {
+            counters.emplace_back(new PerfCounter(event.second));
+        }
+    }
+
+    for (auto& counter : counters) {
+        counter->start();
+    }
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto stop = std::chrono::steady_clock::now();
+    std::vector<std::uint64_t> counts;
+    for (auto& counter : counters) {
+        counts.push_back(counter->stop());
+    }
+
+    BenchmarkResult result;
+    result.name = name;
+    result.operations = operations;
+    result.seconds = std::chrono::duration<double>(stop - start).count();
+
+    double ops = operations > 0 ? static_cast<double>(operations) : 1.0;
+    for (std::size_t i = 0; i < counters.size(); ++i) {
+        if (counters[i]->available()) {
+            result.metrics.emplace_back(std::string(counterEvents[i].first) + "_per_op", counts[i] / ops);
+        }
+    }
+    if (counters.size() > 1 && counters[0]->available() && counters[1]->available() && counts[0] > 0) {
+        result.metrics.emplace_back("ipc", static_cast<double>(counts[1]) / counts[0]);
+    }
+    return result;
+}
+
+void printJson(const std::vector<BenchmarkResult>& results)
+{
+    // Which counters were requested and which the system granted, so an
+    // absent metric can be told apart from one that was not asked for.
+    std::cout << "{\n  \"perf_counters\": {\"requested\": " << (collectCounters ? "true" : "false")
+        << ", \"available\": [";
+    if (collectCounters) {
+        bool first = true;
+        for (const auto& event : counterEvents) {
+            PerfCounter probe(event.second);
+            if (probe.available()) {
+                std::cout << (first ? "" : ", ") << "\"" << event.first << "\"";
+                first = false;
+            }
+        }
+    }
+    std::cout << "]},\n  \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        double ops = static_cast<double>(r.operations);
+        std::cout << (i == 0 ? "\n" : ",\n")
+            << "    {\"name\": \"" << r.name << "\""
+            << ", \"operations\": " << r.operations
+            << ", \"seconds\": " << r.seconds
+            << ", \"ns_per_op\": " << (ops > 0 ? r.seconds * 1e9 / ops : 0.0)
+            << ", \"ops_per_sec\": " << (r.seconds > 0 ? ops / r.seconds : 0.0);
+        for (const auto& metric : r.metrics) {
+            std::cout << ", \"" << metric.first << "\": " << metric.second;
+        }
+        std::cout << "}";
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Workload Generators
+
+// Keys 0..n-1 in random order, so the unbalanced tree stays O(log n) deep.
+std::vector<int> shuffledKeys(std::size_t n, std::mt19937& rng)
+{
+    std::vector<int> keys(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        keys[i] = static_cast<int>(i);
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+// 'count' keys drawn from 0..n-1 with Zipf(s) popularity. Ranks are mapped
+// through a permutation so the hot keys are scattered across the tree.
+std::vector<int> zipfianKeys(std::size_t n, std::size_t count, double s, std::mt19937& rng)
+{
+    std::vector<double> cdf(n);
+    double total = 0;
+    for (std::size_t rank = 0; rank < n; ++rank) {
+        total += 1.0 / std::pow(static_cast<double>(rank + 1), s);
+        cdf[rank] = total;
+    }
+
+    std::vector<int> keyForRank = shuffledKeys(n, rng);
+    std::uniform_real_distribution<double> uniform(0.0, total);
+    std::vector<int> stream(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        std::size_t rank = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+        stream[i] = keyForRank[std::min(rank, n - 1)];
+    }
+    return stream;
+}
+
+template <typename Engine>
+void fillDictionary(Engine& dict, const std::vector<int>& keys)
+{
+    for (int key : keys) {
+        dict.insert(key, "item" + std::to_string(key));
+    }
+}
+
+template <typename Engine>
+std::size_t lookupAll(Engine& dict, const std::vector<int>& keys)
+{
+    std::size_t found = 0;
+    for (int key : keys) {
+        const auto* item = dict.lookup(key);
+        if (item != nullptr) {
+            found += item->size();
+        }
+    }
+    return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Benchmark Cases
+
+// The three core operations on their own, in random key order; the
+// baseline that --counters breaks down into cycles and misses per operation.
+void benchCoreOps(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 1000000;
+    std::mt19937 rng(38);
+    std::vector<int> keys = shuffledKeys(entries, rng);
+    std::vector<int> probes = shuffledKeys(entries, rng);
+
+    Dictionary dict;
+    results.push_back(measure("core_insert", entries, [&] { fillDictionary(dict, keys); }));
+    results.push_back(measure("core_lookup", entries, [&] { benchmarkSink = lookupAll(dict, probes); }));
+    results.push_back(measure("core_remove", entries, [&] {
+        for (int key : probes) {
+            dict.remove(key);
+        }
+        benchmarkSink = dict.size();
+    }));
+}
+
+// Zipfian point lookups with and without the hot-key cache.
+void benchLookupCache(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 1000000;
+    const std::size_t lookups = 4000000;
+    std::mt19937 rng(26);
+
+    Dictionary dict;
+    fillDictionary(dict, shuffledKeys(entries, rng));
+    std::vector<int> stream = zipfianKeys(entries, lookups, 0.99, rng);
+
+    const std::size_t slotCounts[] = { 0, 1024, 4096, 65536 };
+    for (std::size_t slots : slotCounts) {
+        if (slots == 0) {
+            dict.disableLookupCache();
+        }
+        else {
+            dict.enableLookupCache(slots);
+        }
+
+        BenchmarkResult result = measure("lookup_zipf_cache_" + std::to_string(slots), lookups,
+            [&] { benchmarkSink = lookupAll(dict, stream); });
+
+        Dictionary::CacheStats stats = dict.cacheStats();
+        double probes = static_cast<double>(stats.hits + stats.misses);
+        result.metrics.emplace_back("cache_slots", static_cast<double>(slots));
+        result.metrics.emplace_back("hit_rate", probes > 0 ? stats.hits / probes : 0.0);
+        results.push_back(result);
+    }
+}
+
+// Lookups where 70% of keys are absent, with and without the membership filter.
+void benchMembershipFilter(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 1000000;
+    const std::size_t lookups = 4000000;
+    std::mt19937 rng(27);
+
+    // Present keys are even and absent ones odd, so misses end all over the tree.
+    std::vector<int> keys = shuffledKeys(entries, rng);
+    for (int& key : keys) {
+        key *= 2;
+    }
+    Dictionary dict;
+    fillDictionary(dict, keys);
+
+    std::uniform_int_distribution<int> index(0, static_cast<int>(entries) - 1);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::vector<int> stream(lookups);
+    for (int& key : stream) {
+        key = 2 * index(rng) + (coin(rng) < 0.7 ? 1 : 0);
+    }
+
+    const double rates[] = { 0.0, 0.05, 0.01, 0.001 };
+    for (double rate : rates) {
+        if (rate == 0.0) {
+            dict.disableMembershipFilter();
+        }
+        else {
+            dict.enableMembershipFilter(entries, rate);
+        }
+
+        BenchmarkResult result = measure("lookup_70pct_absent_filter_" + std::to_string(rate), lookups,
+            [&] { benchmarkSink = lookupAll(dict, stream); });
+
+        Dictionary::FilterStats stats = dict.filterStats();
+        double passed = static_cast<double>(stats.falsePositives);
+        double absentLookups = static_cast<double>(stats.negatives + stats.falsePositives);
+        result.metrics.emplace_back("target_fp_rate", rate);
+        result.metrics.emplace_back("expected_fp_rate", stats.falsePositiveRate);
+        result.metrics.emplace_back("measured_fp_rate", absentLookups > 0 ? passed / absentLookups : 0.0);
+        result.metrics.emplace_back("filter_bytes_per_entry", static_cast<double>(stats.memoryBytes) / entries);
+        result.metrics.emplace_back("hash_functions", static_cast<double>(stats.hashFunctions));
+        results.push_back(result);
+    }
+}
+
+// Uniform point lookups through the tree and through the hybrid hash index,
+// with the index's memory overhead per entry.
+void benchHashIndex(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 1000000;
+    const std::size_t lookups = 4000000;
+    std::mt19937 rng(29);
+
+    Dictionary dict;
+    fillDictionary(dict, shuffledKeys(entries, rng));
+    std::uniform_int_distribution<int> index(0, static_cast<int>(entries) - 1);
+    std::vector<int> stream(lookups);
+    for (int& key : stream) {
+        key = index(rng);
+    }
+
+    for (int indexed = 0; indexed < 2; ++indexed) {
+        if (indexed) {
+            dict.enableHashIndex();
+        }
+        BenchmarkResult result = measure(indexed ? "lookup_uniform_hash_index" : "lookup_uniform_tree",
+            lookups, [&] { benchmarkSink = lookupAll(dict, stream); });
+
+        Dictionary::IndexStats stats = dict.hashIndexStats();
+        result.metrics.emplace_back("tree_bytes_per_entry", static_cast<double>(dict.evictionStats().bytes) / entries);
+        result.metrics.emplace_back("index_bytes_per_entry", static_cast<double>(stats.memoryBytes) / entries);
+        result.metrics.emplace_back("index_load_factor", stats.loadFactor);
+        results.push_back(result);
+    }
+
+    // Write cost of keeping the index up to date.
+    for (int indexed = 0; indexed < 2; ++indexed) {
+        std::vector<int> keys = shuffledKeys(entries, rng);
+        Dictionary fresh;
+        if (indexed) {
+            fresh.enableHashIndex();
+        }
+        results.push_back(measure(indexed ? "insert_hash_index" : "insert_tree", entries,
+            [&] { fillDictionary(fresh, keys); }));
+    }
+}
+
+// Insert and look up a dense, shuffled key range with each engine.
+template <typename Engine>
+void benchEngine(const std::string& engineName, std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 1000000;
+    std::mt19937 rng(30);
+    std::vector<int> keys = shuffledKeys(entries, rng);
+
+    Engine dict;
+    results.push_back(measure("insert_dense_" + engineName, entries, [&] { fillDictionary(dict, keys); }));
+    std::shuffle(keys.begin(), keys.end(), rng);
+    results.push_back(measure("lookup_dense_" + engineName, entries,
+        [&] { benchmarkSink = lookupAll(dict, keys); }));
+}
+
+void benchEngines(std::vector<BenchmarkResult>& results)
+{
+    benchEngine<Dictionary>("tree", results);
+    benchEngine<RadixDictionary>("radix", results);
+    benchEngine<CompactDictionary>("compact", results);
+}
+
+// Uniform hit lookups against the pointer-linked tree and the hot/cold split
+// built from the same insertion order, with estimated memory per entry.
+void benchHotCold(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t sizes[] = { 100000, 1000000, 4000000 };
+    const std::size_t lookups = 4000000;
+    for (std::size_t entries : sizes) {
+        std::mt19937 rng(35);
+        std::vector<int> keys = shuffledKeys(entries, rng);
+        std::uniform_int_distribution<int> index(0, static_cast<int>(entries) - 1);
+        std::vector<int> stream(lookups);
+        for (int& key : stream) {
+            key = index(rng);
+        }
+        std::string suffix = "_" + std::to_string(entries);
+
+        {
+            Dictionary dict;
+            fillDictionary(dict, keys);
+            BenchmarkResult result = measure("lookup_node_layout" + suffix, lookups,
+                [&] { benchmarkSink = lookupAll(dict, stream); });
+            result.metrics.emplace_back("bytes_per_entry", static_cast<double>(dict.evictionStats().bytes) / entries);
+            results.push_back(result);
+        }
+        {
+            CompactDictionary dict;
+            fillDictionary(dict, keys);
+            BenchmarkResult result = measure("lookup_hot_cold" + suffix, lookups,
+                [&] { benchmarkSink = lookupAll(dict, stream); });
+            CompactDictionary::MemoryStats stats = dict.memoryStats();
+            result.metrics.emplace_back("bytes_per_entry", static_cast<double>(stats.indexBytes + stats.itemBytes) / entries);
+            result.metrics.emplace_back("index_bytes_per_entry", static_cast<double>(stats.indexBytes) / entries);
+            results.push_back(result);
+        }
+    }
+}
+
+// Copying a tree: copyTree walks and allocates every node, while the arena
+// is one block copy plus the items.
+void benchArenaCopy(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 1000000;
+    std::mt19937 rng(36);
+    std::vector<int> keys = shuffledKeys(entries, rng);
+
+    Dictionary tree;
+    fillDictionary(tree, keys);
+    BenchmarkResult treeResult = measure("copy_pointer_nodes", entries, [&] {
+        Dictionary copy(tree);
+        benchmarkSink = copy.size();
+    });
+    treeResult.metrics.emplace_back("link_bytes_per_entry", 2 * sizeof(void*));
+    results.push_back(treeResult);
+
+    CompactDictionary arena;
+    arena.reserve(entries);
+    fillDictionary(arena, keys);
+    BenchmarkResult arenaResult = measure("copy_index_arena", entries, [&] {
+        CompactDictionary copy(arena);
+        benchmarkSink = copy.size();
+    });
+    arenaResult.metrics.emplace_back("link_bytes_per_entry", 2 * sizeof(std::uint32_t));
+    results.push_back(arenaResult);
+}
+
+// Dictionary behind one mutex, the baseline for the concurrent engines.
+class MutexDictionary {
+public:
+    void insert(int key, const std::string& item)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        dict.insert(key, item);
+    }
+
+    bool lookup(int key, std::string& item)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string* found = dict.lookup(key);
+        if (found != nullptr) {
+            item = *found;
+        }
+        return found != nullptr;
+    }
+
+    void remove(int key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        dict.remove(key);
+    }
+
+private:
+    std::mutex mutex;
+    Dictionary dict;
+};
+
+// A fixed number of operations split across 'threads' threads over a shared
+// key range; 'readPercent' of them are lookups, the rest inserts and removes.
+template <typename Engine>
+BenchmarkResult runContention(const std::string& name, int threads, int readPercent)
+{
+    const int keySpace = 1 << 18;
+    const std::size_t operations = 1000000;
+
+    Engine dict;
+    std::mt19937 rng(32);
+    std::vector<int> keys = shuffledKeys(keySpace, rng);
+    for (int i = 0; i < keySpace / 2; ++i) {
+        dict.insert(keys[i], "item" + std::to_string(keys[i])); // Half the range present
+    }
+
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937 local(320 + t);
+            std::string item;
+            std::size_t found = 0;
+            ++ready;
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            for (std::size_t op = t; op < operations; op += threads) {
+                int key = static_cast<int>(local() % keySpace);
+                int roll = static_cast<int>(local() % 100);
+                if (roll < readPercent) {
+                    found += dict.lookup(key, item) ? 1 : 0;
+                }
+                else if (roll % 2 == 0) {
+                    dict.insert(key, "item" + std::to_string(key));
+                }
+                else {
+                    dict.remove(key);
+                }
+            }
+            benchmarkSink = found;
+        });
+    }
+
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+    BenchmarkResult result = measure(name, operations, [&] {
+        go.store(true);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    });
+    result.metrics.emplace_back("threads", threads);
+    result.metrics.emplace_back("read_percent", readPercent);
+    return result;
+}
+
+// Mutex-guarded Dictionary against the lock-free skip list at 1-64 threads
+// and read-mostly, mixed and write-heavy workloads.
+void benchContention(std::vector<BenchmarkResult>& results)
+{
+    const int readPercents[] = { 90, 50, 10 };
+    for (int readPercent : readPercents) {
+        for (int threads = 1; threads <= 64; threads *= 2) {
+            std::string suffix = "_r" + std::to_string(readPercent) + "_t" + std::to_string(threads);
+            results.push_back(runContention<MutexDictionary>("contention_mutex" + suffix, threads, readPercent));
+            results.push_back(runContention<LockFreeDictionary>("contention_lock_free" + suffix, threads, readPercent));
+        }
+    }
+}
+
+// Ingest shuffled keys from several threads, each insert under one lock,
+// against producers feeding a BatchedWriter (timed until flushed).
+void benchBatchedWrites(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 1000000;
+    std::mt19937 rng(33);
+    std::vector<int> keys = shuffledKeys(entries, rng);
+
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        Dictionary locked;
+        std::mutex lockedMutex;
+        BenchmarkResult baseline = measure("ingest_locked_t" + std::to_string(threads), entries, [&] {
+            std::vector<std::thread> producers;
+            for (int t = 0; t < threads; ++t) {
+                producers.emplace_back([&, t] {
+                    for (std::size_t i = t; i < entries; i += threads) {
+                        std::lock_guard<std::mutex> lock(lockedMutex);
+                        locked.insert(keys[i], "item" + std::to_string(keys[i]));
+                    }
+                });
+            }
+            for (std::thread& producer : producers) {
+                producer.join();
+            }
+        });
+        baseline.metrics.emplace_back("threads", threads);
+        results.push_back(baseline);
+
+        Dictionary batched;
+        std::mutex batchedMutex;
+        BatchedWriter writer(batched, batchedMutex);
+        std::vector<BatchedWriter::Producer*> queues;
+        for (int t = 0; t < threads; ++t) {
+            queues.push_back(&writer.producer());
+        }
+        BenchmarkResult result = measure("ingest_batched_t" + std::to_string(threads), entries, [&] {
+            std::vector<std::thread> producers;
+            for (int t = 0; t < threads; ++t) {
+                producers.emplace_back([&, t] {
+                    for (std::size_t i = t; i < entries; i += threads) {
+                        queues[t]->insert(keys[i], "item" + std::to_string(keys[i]));
+                    }
+                });
+            }
+            for (std::thread& producer : producers) {
+                producer.join();
+            }
+            writer.flush();
+        });
+        BatchedWriter::BatchStats stats = writer.stats();
+        result.metrics.emplace_back("threads", threads);
+        result.metrics.emplace_back("batches", static_cast<double>(stats.batches));
+        result.metrics.emplace_back("mean_batch", static_cast<double>(stats.writes) / std::max<std::size_t>(stats.batches, 1));
+        results.push_back(result);
+    }
+
+    // The merged pass alone: one sorted batch against key-by-key inserts.
+    std::vector<int> sorted(keys);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<Dictionary::BatchWrite> writes;
+    for (int key : sorted) {
+        writes.push_back(Dictionary::BatchWrite{ key, false, "new" });
+    }
+    Dictionary dict;
+    fillDictionary(dict, keys);
+    results.push_back(measure("update_sorted_key_by_key", entries, [&] {
+        for (int key : sorted) {
+            dict.insert(key, "new");
+        }
+    }));
+    results.push_back(measure("update_sorted_apply_batch", entries, [&] { dict.applyBatch(writes); }));
+}
+
+// removeIf over 10M entries dropping 10% of them, key by key and in
+// parallel, with a cheap key test and an expensive test of the item.
+void benchRemoveIf(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 10000000;
+    std::mt19937 rng(34);
+    Dictionary source;
+    fillDictionary(source, shuffledKeys(entries, rng));
+
+    auto cheap = [](int key, const std::string&) { return key % 10 == 0; };
+    auto expensive = [](int key, const std::string& item) {
+        std::uint64_t hash = 14695981039346656037ull; // FNV-1a, repeated
+        for (int round = 0; round < 64; ++round) {
+            for (char c : item) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            }
+        }
+        return (hash ^ static_cast<std::uint64_t>(key)) % 10 == 0;
+    };
+    const std::pair<const char*, std::function<bool(int, const std::string&)>> predicates[] = {
+        { "cheap", cheap }, { "expensive", expensive },
+    };
+
+    for (const auto& predicate : predicates) {
+        std::string suffix = std::string("_") + predicate.first;
+        {
+            Dictionary dict(source);
+            results.push_back(measure("remove_if_serial" + suffix, entries,
+                [&] { dict.removeIf(predicate.second); }));
+        }
+        for (unsigned threads = 1; threads <= 8; threads *= 2) {
+            Dictionary dict(source);
+            BenchmarkResult result = measure("remove_if_parallel" + suffix + "_t" + std::to_string(threads), entries,
+                [&] { dict.removeIfParallel(predicate.second, threads); });
+            result.metrics.emplace_back("threads", threads);
+            result.metrics.emplace_back("remaining", static_cast<double>(dict.size()));
+            results.push_back(result);
+        }
+    }
+}
+
+// Uniform hit lookups in the frozen layouts, with and without huge pages,
+// counting data-TLB misses where perf counters are available.
+void benchFrozenLayouts(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t sizes[] = { 1000000, 8000000 };
+    const std::size_t lookups = 4000000;
+    const std::pair<const char*, FrozenDictionary::Layout> layouts[] = {
+        { "sorted", FrozenDictionary::Layout::Sorted },
+        { "eytzinger", FrozenDictionary::Layout::Eytzinger },
+        { "veb", FrozenDictionary::Layout::VanEmdeBoas },
+    };
+    PerfCounter tlbMisses(PerfEvent::DtlbReadMisses);
+
+    for (std::size_t entries : sizes) {
+        std::mt19937 rng(37);
+        Dictionary source;
+        fillDictionary(source, shuffledKeys(entries, rng));
+        std::uniform_int_distribution<int> index(0, static_cast<int>(entries) - 1);
+        std::vector<int> stream(lookups);
+        for (int& key : stream) {
+            key = index(rng);
+        }
+
+        for (const auto& layout : layouts) {
+            for (int huge = 0; huge < 2; ++huge) {
+                FrozenDictionary frozen(source, layout.second, huge != 0);
+                std::uint64_t misses = 0;
+                BenchmarkResult result = measure(std::string("lookup_frozen_") + layout.first +
+                    (huge ? "_huge_" : "_") + std::to_string(entries), lookups, [&] {
+                    tlbMisses.start();
+                    benchmarkSink = lookupAll(frozen, stream);
+                    misses = tlbMisses.stop();
+                });
+                result.metrics.emplace_back("huge_pages", frozen.hugePages() ? 1 : 0);
+                result.metrics.emplace_back("buffer_bytes_per_entry", static_cast<double>(frozen.bufferBytes()) / entries);
+                if (tlbMisses.available()) {
+                    result.metrics.emplace_back("dtlb_misses_per_lookup", static_cast<double>(misses) / lookups);
+                }
+                results.push_back(result);
+            }
+        }
+    }
+}
+
+// Size and hit-lookup latency of the packed frozen keys against the
+// pointer-based tree and an uncompressed sorted array, on dense keys (every
+// other integer) and on keys spread over the whole int range. Bits per key
+// count the search structure; for the tree, whole nodes without item text.
+void benchPackedKeys(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 2000000;
+    const std::size_t lookups = 4000000;
+    const char* const spreads[] = { "dense", "sparse" };
+
+    for (const char* spread : spreads) {
+        std::mt19937 rng(43);
+        std::vector<int> keys = shuffledKeys(entries, rng);
+        if (std::strcmp(spread, "dense") == 0) {
+            for (int& key : keys) {
+                key *= 2;
+            }
+        }
+        else {
+            std::vector<int> scattered(entries);
+            for (int& key : scattered) {
+                key = static_cast<int>(rng());
+            }
+            std::sort(scattered.begin(), scattered.end());
+            scattered.erase(std::unique(scattered.begin(), scattered.end()), scattered.end());
+            std::shuffle(scattered.begin(), scattered.end(), rng);
+            keys.swap(scattered);
+        }
+
+        Dictionary dict;
+        std::size_t itemBytes = 0;
+        for (int key : keys) {
+            std::string item = "item" + std::to_string(key);
+            itemBytes += item.size();
+            dict.insert(key, item);
+        }
+        std::vector<int> stream(lookups);
+        for (int& key : stream) {
+            key = keys[rng() % keys.size()];
+        }
+        double n = static_cast<double>(keys.size());
+        std::string suffix = std::string("_") + spread;
+
+        BenchmarkResult tree = measure("lookup_tree" + suffix, lookups, [&] { benchmarkSink = lookupAll(dict, stream); });
+        tree.metrics.emplace_back("bits_per_key", (dict.evictionStats().bytes - itemBytes) * 8.0 / n);
+        results.push_back(tree);
+
+        const std::pair<const char*, FrozenDictionary::Layout> layouts[] = {
+            { "sorted", FrozenDictionary::Layout::Sorted },
+            { "packed", FrozenDictionary::Layout::Packed },
+        };
+        for (const auto& layout : layouts) {
+            FrozenDictionary frozen(dict, layout.second, false);
+            BenchmarkResult result = measure(std::string("lookup_") + layout.first + suffix, lookups,
+                [&] { benchmarkSink = lookupAll(frozen, stream); });
+            result.metrics.emplace_back("bits_per_key", frozen.bufferBytes() * 8.0 / n);
+            results.push_back(result);
+        }
+    }
+}
+
+// Inserts from sorted, nearly-sorted and random streams, each through plain
+// insert and through an insert cursor. The tree is unbalanced, so ascending
+// keys build a spine that plain insert walks in full every time.
+void benchInsertCursor(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 20000;
+    std::mt19937 rng(42);
+
+    std::vector<std::pair<std::string, std::vector<int>>> streams;
+    std::vector<int> sorted(entries);
+    for (std::size_t i = 0; i < entries; ++i) {
+        sorted[i] = static_cast<int>(i);
+    }
+    streams.emplace_back("sorted", sorted);
+    std::vector<int> nearly(sorted);
+    for (std::size_t i = 0; i + 8 <= entries; i += 8) {
+        std::shuffle(nearly.begin() + i, nearly.begin() + i + 8, rng); // Disorder within windows of 8
+    }
+    streams.emplace_back("nearly_sorted", nearly);
+    streams.emplace_back("random", shuffledKeys(entries, rng));
+
+    for (const auto& stream : streams) {
+        results.push_back(measure("insert_plain_" + stream.first, entries, [&] {
+            Dictionary dict;
+            for (int key : stream.second) {
+                dict.insert(key, "item");
+            }
+            benchmarkSink = dict.size();
+        }));
+        results.push_back(measure("insert_cursor_" + stream.first, entries, [&] {
+            Dictionary dict;
+            Dictionary::InsertCursor cursor(dict);
+            for (int key : stream.second) {
+                cursor.insert(key, "item");
+            }
+            benchmarkSink = dict.size();
+        }));
+    }
+}
+
+// A tree that has lived a while: random inserts interleaved with unrelated
+// allocations, then half the keys replaced, so nodes are scattered over the
+// heap in no relation to key order.
+void buildFragmented(Dictionary& dict, std::size_t entries, std::mt19937& rng)
+{
+    std::vector<int> keys = shuffledKeys(2 * entries, rng);
+    {
+        std::vector<std::string> noise;
+        for (std::size_t i = 0; i < entries; ++i) {
+            dict.insert(keys[i], "item" + std::to_string(keys[i]));
+            noise.emplace_back(16 + rng() % 64, 'x');
+        }
+    }
+    for (std::size_t i = 0; i < entries / 2; ++i) {
+        dict.remove(keys[i]);
+        dict.insert(keys[entries + i], "item" + std::to_string(keys[entries + i]));
+    }
+}
+
+// Hit lookups on a fragmented tree before and after compact(), the cost of
+// compacting, and the same work spread over 1 ms slices.
+void benchCompaction(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 1000000;
+    const std::size_t lookups = 2000000;
+    std::mt19937 rng(44);
+    Dictionary dict;
+    buildFragmented(dict, entries, rng);
+
+    std::vector<int> present;
+    present.reserve(entries);
+    dict.forEach([&](int key, const std::string&) { present.push_back(key); });
+    std::vector<int> stream(lookups);
+    for (int& key : stream) {
+        key = present[rng() % present.size()];
+    }
+
+    BenchmarkResult before = measure("lookup_fragmented", lookups, [&] { benchmarkSink = lookupAll(dict, stream); });
+    before.metrics.emplace_back("height", static_cast<double>(dict.height()));
+    results.push_back(before);
+    results.push_back(measure("compact_full", entries, [&] { dict.compact(); }));
+    BenchmarkResult after = measure("lookup_compacted", lookups, [&] { benchmarkSink = lookupAll(dict, stream); });
+    after.metrics.emplace_back("height", static_cast<double>(dict.height()));
+    results.push_back(after);
+
+    Dictionary live;
+    buildFragmented(live, entries, rng);
+    std::vector<double> slices; // Milliseconds each
+    BenchmarkResult sliced = measure("compact_sliced_1ms", entries, [&] {
+        bool done = false;
+        while (!done) {
+            auto start = std::chrono::steady_clock::now();
+            done = live.compactFor(std::chrono::milliseconds(1));
+            slices.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+    });
+    std::sort(slices.begin(), slices.end());
+    sliced.metrics.emplace_back("slices", static_cast<double>(slices.size()));
+    sliced.metrics.emplace_back("p99_slice_ms", slices[slices.size() * 99 / 100]);
+    sliced.metrics.emplace_back("longest_slice_ms", slices.back());
+    results.push_back(sliced);
+}
+
+// Write amplification and memory of the item index: inserts, overwrites and
+// removals with and without it, for a few shared items and for an item per
+// key, then reverse lookups against the traversal they replace.
+void benchItemIndex(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t entries = 1000000;
+    const std::size_t reverseLookups = 20;
+    const char* const names[] = { "Jane", "Mary", "Harold", "Edward", "Victoria", "Matilda", "Oliver", "Elizabeth" };
+    std::mt19937 rng(45);
+    std::vector<int> keys = shuffledKeys(entries, rng);
+
+    const std::pair<const char*, std::function<std::string(int, int)>> cardinalities[] = {
+        { "shared", [&](int key, int round) { return std::string(names[(key + round) % 8]); } },
+        { "distinct", [](int key, int round) { return "item" + std::to_string(key) + "_" + std::to_string(round); } },
+    };
+    for (const auto& cardinality : cardinalities) {
+        double plainSeconds[3] = {};
+        for (int indexed = 0; indexed < 2; ++indexed) {
+            std::string suffix = std::string("_") + cardinality.first + (indexed ? "_indexed" : "_plain");
+            Dictionary dict;
+            if (indexed) {
+                dict.enableItemIndex();
+            }
+            BenchmarkResult phases[] = {
+                measure("item_insert" + suffix, entries, [&] {
+                    for (int key : keys) {
+                        dict.insert(key, cardinality.second(key, 0));
+                    }
+                }),
+                measure("item_overwrite" + suffix, entries, [&] {
+                    for (int key : keys) {
+                        dict.insert(key, cardinality.second(key, 1));
+                    }
+                }),
+                measure("item_remove" + suffix, entries / 2, [&] {
+                    for (std::size_t i = 0; i < entries / 2; ++i) {
+                        dict.remove(keys[i]);
+                    }
+                }),
+            };
+            for (int phase = 0; phase < 3; ++phase) {
+                if (indexed) {
+                    phases[phase].metrics.emplace_back("write_amplification", phases[phase].seconds / plainSeconds[phase]);
+                }
+                else {
+                    plainSeconds[phase] = phases[phase].seconds;
+                }
+            }
+            if (indexed) {
+                Dictionary::ItemIndexStats stats = dict.itemIndexStats();
+                phases[2].metrics.emplace_back("items", static_cast<double>(stats.items));
+                phases[2].metrics.emplace_back("index_bytes_per_entry", static_cast<double>(stats.memoryBytes) / dict.size());
+                phases[2].metrics.emplace_back("tree_bytes_per_entry", static_cast<double>(dict.evictionStats().bytes) / dict.size());
+            }
+            results.insert(results.end(), phases, phases + 3);
+
+            if (std::string(cardinality.first) == "shared") {
+                results.push_back(measure("keys_for" + suffix, reverseLookups, [&] {
+                    for (std::size_t i = 0; i < reverseLookups; ++i) {
+                        benchmarkSink = dict.keysFor(names[i % 8]).size();
+                    }
+                }));
+            }
+        }
+    }
+}
+
+// Replace, remove and add 'changes' keys in about equal parts.
+void applyChanges(Dictionary& dict, std::size_t entries, std::size_t changes, std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> index(0, static_cast<int>(entries) - 1);
+    for (std::size_t i = 0; i < changes; ++i) {
+        switch (i % 3) {
+        case 0: dict.insert(index(rng), "changed"); break;
+        case 1: dict.remove(index(rng)); break;
+        default: dict.insert(static_cast<int>(entries + i), "added"); break;
+        }
+    }
+}
+
+// What replicas do without content hashes: dump both in key order and
+// compare every entry.
+std::size_t compareAllEntries(const Dictionary& a, const Dictionary& b)
+{
+    std::vector<std::pair<int, const std::string*>> left, right;
+    left.reserve(a.size());
+    right.reserve(b.size());
+    a.forEach([&](int key, const std::string& item) { left.emplace_back(key, &item); });
+    b.forEach([&](int key, const std::string& item) { right.emplace_back(key, &item); });
+    std::size_t changed = 0;
+    std::size_t i = 0, j = 0;
+    while (i < left.size() || j < right.size()) {
+        if (j == right.size() || (i < left.size() && left[i].first < right[j].first)) {
+            ++changed, ++i;
+        }
+        else if (i == left.size() || right[j].first < left[i].first) {
+            ++changed, ++j;
+        }
+        else {
+            changed += *left[i++].second != *right[j++].second ? 1 : 0;
+        }
+    }
+    return changed;
+}
+
+// Replica checks on two 10M-entry dictionaries differing in 0.1% of keys:
+// O(1) equality, diff of a changed copy (same shape, so the trees are
+// walked in lockstep), and the full comparison both replace. At 1M, the
+// replica is rebuilt in another order, so diff must split ranges across
+// different shapes.
+void benchMerkleDiff(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t sizes[] = { 10000000, 1000000 };
+    const std::size_t equalityChecks = 1000000;
+    for (std::size_t entries : sizes) {
+        std::string suffix = "_" + std::to_string(entries);
+        bool reshaped = entries < sizes[0];
+        std::size_t changes = entries / 1000;
+        std::mt19937 rng(46);
+        std::vector<int> keys = shuffledKeys(entries, rng);
+        Dictionary primary;
+        fillDictionary(primary, keys);
+        Dictionary replica;
+        if (reshaped) {
+            std::shuffle(keys.begin(), keys.end(), rng);
+            fillDictionary(replica, keys);
+        }
+        else {
+            replica = primary;
+        }
+        applyChanges(replica, entries, changes, rng);
+
+        results.push_back(measure("content_equals" + suffix, equalityChecks, [&] {
+            for (std::size_t i = 0; i < equalityChecks; ++i) {
+                benchmarkSink = primary.contentEquals(replica) ? 1 : 0;
+            }
+        }));
+        std::size_t found = 0;
+        BenchmarkResult diff = measure(std::string(reshaped ? "diff_reshaped" : "diff_copy") + suffix, entries,
+            [&] { found = primary.diff(replica).size(); });
+        diff.metrics.emplace_back("changed_keys", static_cast<double>(found));
+        results.push_back(diff);
+        BenchmarkResult full = measure("compare_all" + suffix, entries, [&] { found = compareAllEntries(primary, replica); });
+        full.metrics.emplace_back("changed_keys", static_cast<double>(found));
+        results.push_back(full);
+    }
+}
+
+// A 1024-entry configuration table, generated and laid out at compile time.
+constexpr std::array<StaticEntry, 1024> makeConfigEntries()
+{
+    constexpr std::string_view names[] = {
+        "Jane", "Mary", "Harold", "Edward", "Victoria", "Matilda", "Oliver", "Elizabeth",
+    };
+    std::array<StaticEntry, 1024> entries{};
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        entries[i] = StaticEntry{ static_cast<int>(i * 40503 % 65536), names[i % 8] }; // Distinct, unsorted
+    }
+    return entries;
+}
+
+static constexpr std::array<StaticEntry, 1024> configEntries = makeConfigEntries();
+static constexpr StaticDictionary configTable(configEntries);
+
+// Lookups in the compile-time table against the same contents built at
+// startup, and the startup cost the static table avoids.
+void benchStaticTable(std::vector<BenchmarkResult>& results)
+{
+    const std::size_t lookups = 4000000;
+    const std::size_t builds = 2000;
+    std::mt19937 rng(41);
+
+    auto buildDictionary = [](Dictionary& dict) {
+        for (const StaticEntry& entry : configEntries) {
+            dict.insert(entry.key, std::string(entry.item));
+        }
+    };
+    results.push_back(measure("build_runtime_1024", builds * configEntries.size(), [&] {
+        for (std::size_t i = 0; i < builds; ++i) {
+            Dictionary dict;
+            buildDictionary(dict);
+            benchmarkSink = dict.size();
+        }
+    }));
+
+    Dictionary dict;
+    buildDictionary(dict);
+    FrozenDictionary frozen(dict, FrozenDictionary::Layout::Eytzinger, false);
+
+    // Nine in ten lookups hit.
+    std::vector<int> stream(lookups);
+    for (int& key : stream) {
+        key = rng() % 10 != 0 ? configEntries[rng() % configEntries.size()].key : static_cast<int>(rng() % 65536);
+    }
+
+    results.push_back(measure("lookup_static_1024", lookups, [&] { benchmarkSink = lookupAll(configTable, stream); }));
+    results.push_back(measure("lookup_runtime_1024", lookups, [&] { benchmarkSink = lookupAll(dict, stream); }));
+    results.push_back(measure("lookup_frozen_1024", lookups, [&] { benchmarkSink = lookupAll(frozen, stream); }));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct BenchmarkCase {
+    const char* name;
+    void (*run)(std::vector<BenchmarkResult>&);
+};
+
+static const BenchmarkCase benchmarkCases[] = {
+    { "core_ops", benchCoreOps },
+    { "lookup_cache", benchLookupCache },
+    { "membership_filter", benchMembershipFilter },
+    { "hash_index", benchHashIndex },
+    { "engines", benchEngines },
+    { "hot_cold", benchHotCold },
+    { "arena_copy", benchArenaCopy },
+    { "frozen_layouts", benchFrozenLayouts },
+    { "packed_keys", benchPackedKeys },
+    { "static_table", benchStaticTable },
+    { "insert_cursor", benchInsertCursor },
+    { "contention", benchContention },
+    { "batched_writes", benchBatchedWrites },
+    { "remove_if", benchRemoveIf },
+    { "compaction", benchCompaction },
+    { "item_index", benchItemIndex },
+    { "merkle_diff", benchMerkleDiff },
+};
+
+int main(int argc, char* argv[])
+{
+    const char* filter = "";
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--counters") == 0) {
+            collectCounters = true;
+        }
+        else {
+            filter = argv[i];
+        }
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const BenchmarkCase& benchmark : benchmarkCases) {
+        if (std::strstr(benchmark.name, filter) != nullptr) {
+            benchmark.run(results);
+        }
+    }
+
+    printJson(results);
+    return 0;
+}
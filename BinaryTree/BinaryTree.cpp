@@ -10,13 +10,76 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <string>
+#include <map>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <new>
+#include <cmath>
+#include <stdexcept>
+#include <sstream>
+#include <boost/mpl/list.hpp>
 #include "dictionary.h"
+#include "RadixDictionary.h"
+#include "CompactDictionary.h"
+#include "FrozenDictionary.h"
+#include "StaticDictionary.h"
+#include "VersionedDictionary.h"
+#include "LockFreeDictionary.h"
+#include "BatchedWriter.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The conformance suites below (lookup/insert through removeIf) run against
+// every engine that exposes the Dictionary API.
+typedef boost::mpl::list<Dictionary, RadixDictionary, CompactDictionary> Engines;
 
 ////////////////////////////////////////////////////////////////////////////////
 
 // Utility Functions
 
-void isPresent(Dictionary& dict, int k, std::string i)
+// Allocation failure injection for the exception-safety tests: once
+// 'skip' requests of exactly 'size' bytes have passed, the next one throws
+// std::bad_alloc, on whichever thread makes it. A size of 0 disables it.
+static std::atomic<std::size_t> failingSize(0);
+static std::atomic<int> failingSkips(0);
+
+void failAllocation(std::size_t size, int skip = 0)
+{
+    failingSkips.store(skip);
+    failingSize.store(size);
+}
+
+void* operator new(std::size_t size)
+{
+    if (size != 0 && size == failingSize.load() && failingSkips.fetch_sub(1) <= 0) {
+        failingSize.store(0);
+        throw std::bad_alloc();
+    }
+    void* memory = std::malloc(size != 0 ? size : 1);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+template <typename Engine>
+void isPresent(Engine& dict, int k, std::string i)
 {
     std::string* p_i = dict.lookup(k);
     BOOST_CHECK_MESSAGE(p_i, std::to_string(k) + " is missing");
@@ -27,13 +90,15 @@ void isPresent(Dictionary& dict, int k, std::string i)
     }
 }
 
-void isAbsent(Dictionary& dict, int k)
+template <typename Engine>
+void isAbsent(Engine& dict, int k)
 {
     BOOST_CHECK_MESSAGE(dict.lookup(k) == nullptr,
         std::to_string(k) + " should be absent, but is present.");
 }
 
-void insertTestData(Dictionary& dict)
+template <typename Engine>
+void insertTestData(Engine& dict)
 {
     dict.insert(22, "Jane");
     dict.insert(22, "Mary");
@@ -57,42 +122,42 @@ void insertTestData(Dictionary& dict)
 
 BOOST_AUTO_TEST_SUITE(Lookup_Insert_Tests)
 
-BOOST_AUTO_TEST_CASE(EmptyLookup)
+BOOST_AUTO_TEST_CASE_TEMPLATE(EmptyLookup, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     isAbsent(dict, 1);
 }
 
-BOOST_AUTO_TEST_CASE(SingleInsert)
+BOOST_AUTO_TEST_CASE_TEMPLATE(SingleInsert, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(22, "Mary");
 }
 
-BOOST_AUTO_TEST_CASE(SingleInsertLookup)
+BOOST_AUTO_TEST_CASE_TEMPLATE(SingleInsertLookup, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(22, "Mary");
     isPresent(dict, 22, "Mary");
 }
 
-BOOST_AUTO_TEST_CASE(SingleOverwriteLookup)
+BOOST_AUTO_TEST_CASE_TEMPLATE(SingleOverwriteLookup, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(22, "Jane");
     dict.insert(22, "Mary");
     isPresent(dict, 22, "Mary");
 }
 
-BOOST_AUTO_TEST_CASE(MultipleInsert)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MultipleInsert, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 }
 
-BOOST_AUTO_TEST_CASE(MultipleInsertLookupPresent)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MultipleInsertLookupPresent, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     isPresent(dict, 22, "Mary");
@@ -110,9 +175,9 @@ BOOST_AUTO_TEST_CASE(MultipleInsertLookupPresent)
     isPresent(dict, -1, "Edward");
 }
 
-BOOST_AUTO_TEST_CASE(MultipleInsertLookupAbsent)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MultipleInsertLookupAbsent, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     isAbsent(dict, 2);
@@ -128,24 +193,24 @@ BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(Remove_Tests)
 
-BOOST_AUTO_TEST_CASE(EmptyRemove)
+BOOST_AUTO_TEST_CASE_TEMPLATE(EmptyRemove, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.remove(43);
     isAbsent(dict, 43);
 }
 
-BOOST_AUTO_TEST_CASE(RemoveChildlessRoot)
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveChildlessRoot, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(7, "John");
     dict.remove(7);
     isAbsent(dict, 7);
 }
 
-BOOST_AUTO_TEST_CASE(RemoveLeftChildOfRoot)
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveLeftChildOfRoot, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(31, "Anne");
     dict.insert(7, "John");
     dict.remove(7);
@@ -154,9 +219,9 @@ BOOST_AUTO_TEST_CASE(RemoveLeftChildOfRoot)
     isPresent(dict, 31, "Anne");
 }
 
-BOOST_AUTO_TEST_CASE(RemoveRightChildOfRoot)
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveRightChildOfRoot, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(7, "John");
     dict.insert(31, "Anne");
     dict.remove(31);
@@ -165,9 +230,9 @@ BOOST_AUTO_TEST_CASE(RemoveRightChildOfRoot)
     isPresent(dict, 7, "John");
 }
 
-BOOST_AUTO_TEST_CASE(InsertMany_RemoveChildlessNodes)
+BOOST_AUTO_TEST_CASE_TEMPLATE(InsertMany_RemoveChildlessNodes, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     dict.remove(-1);
@@ -199,9 +264,9 @@ BOOST_AUTO_TEST_CASE(InsertMany_RemoveChildlessNodes)
     isPresent(dict, 37, "Victoria");
 }
 
-BOOST_AUTO_TEST_CASE(OverwriteThenRemove)
+BOOST_AUTO_TEST_CASE_TEMPLATE(OverwriteThenRemove, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(22, "Jane");
     dict.insert(22, "Mary");
     dict.insert(4, "Matilda");
@@ -219,9 +284,9 @@ BOOST_AUTO_TEST_CASE(OverwriteThenRemove)
     isAbsent(dict, 22);
 }
 
-BOOST_AUTO_TEST_CASE(RemoveRootWithLeftChild)
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveRootWithLeftChild, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(31, "Anne");
     dict.insert(7, "John");
     dict.remove(31);
@@ -230,9 +295,9 @@ BOOST_AUTO_TEST_CASE(RemoveRootWithLeftChild)
     isPresent(dict, 7, "John");
 }
 
-BOOST_AUTO_TEST_CASE(RemoveRootWithRightChild)
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveRootWithRightChild, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(7, "John");
     dict.insert(31, "Anne");
     dict.remove(31);
@@ -241,9 +306,9 @@ BOOST_AUTO_TEST_CASE(RemoveRootWithRightChild)
     isPresent(dict, 7, "John");
 }
 
-BOOST_AUTO_TEST_CASE(InsertMany_RemoveNodesWithOneChild)
+BOOST_AUTO_TEST_CASE_TEMPLATE(InsertMany_RemoveNodesWithOneChild, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     dict.remove(4);
@@ -267,9 +332,9 @@ BOOST_AUTO_TEST_CASE(InsertMany_RemoveNodesWithOneChild)
     isPresent(dict, -1, "Edward");
 }
 
-BOOST_AUTO_TEST_CASE(RemoveRootWithChildren)
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveRootWithChildren, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     dict.insert(31, "Anne");
     dict.insert(7, "John");
     dict.insert(42, "Elizabeth");
@@ -280,9 +345,9 @@ BOOST_AUTO_TEST_CASE(RemoveRootWithChildren)
     isPresent(dict, 42, "Elizabeth");
 }
 
-BOOST_AUTO_TEST_CASE(InsertMany_RemoveNodesWithChildren)
+BOOST_AUTO_TEST_CASE_TEMPLATE(InsertMany_RemoveNodesWithChildren, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     dict.remove(0);
@@ -306,9 +371,9 @@ BOOST_AUTO_TEST_CASE(InsertMany_RemoveNodesWithChildren)
     isPresent(dict, -1, "Edward");
 }
 
-BOOST_AUTO_TEST_CASE(InsertMany_RemoveAbsent)
+BOOST_AUTO_TEST_CASE_TEMPLATE(InsertMany_RemoveAbsent, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     dict.remove(6);
@@ -335,12 +400,12 @@ BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(Copy_Constructor_Tests)
 
-BOOST_AUTO_TEST_CASE(CopyConstructorFullyCopies)
+BOOST_AUTO_TEST_CASE_TEMPLATE(CopyConstructorFullyCopies, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2(dict1);
+    Engine dict2(dict1);
 
     isPresent(dict2, 22, "Mary");
     isPresent(dict2, 4, "Stephen");
@@ -357,12 +422,12 @@ BOOST_AUTO_TEST_CASE(CopyConstructorFullyCopies)
     isPresent(dict2, -1, "Edward");
 }
 
-BOOST_AUTO_TEST_CASE(CopyConstructorDoesNotDeleteSource)
+BOOST_AUTO_TEST_CASE_TEMPLATE(CopyConstructorDoesNotDeleteSource, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2(dict1);
+    Engine dict2(dict1);
 
     isPresent(dict1, 22, "Mary");
     isPresent(dict1, 4, "Stephen");
@@ -379,12 +444,12 @@ BOOST_AUTO_TEST_CASE(CopyConstructorDoesNotDeleteSource)
     isPresent(dict1, -1, "Edward");
 }
 
-BOOST_AUTO_TEST_CASE(CopyConstructorIsDeep)
+BOOST_AUTO_TEST_CASE_TEMPLATE(CopyConstructorIsDeep, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2(dict1);
+    Engine dict2(dict1);
 
     dict1.insert(2, "William");
     isPresent(dict1, 2, "William");
@@ -409,12 +474,12 @@ BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(Move_Constructor_Tests)
 
-BOOST_AUTO_TEST_CASE(MoveConstructorFullyMoves)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MoveConstructorFullyMoves, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2(std::move(dict1));
+    Engine dict2(std::move(dict1));
 
     isPresent(dict2, 22, "Mary");
     isPresent(dict2, 4, "Stephen");
@@ -431,14 +496,14 @@ BOOST_AUTO_TEST_CASE(MoveConstructorFullyMoves)
     isPresent(dict2, -1, "Edward");
 }
 
-BOOST_AUTO_TEST_CASE(MoveConstructorSteals)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MoveConstructorSteals, Engine, Engines)
 {
-    Dictionary* dictPtr;
+    Engine* dictPtr;
     {
-        Dictionary dict1;
+        Engine dict1;
         insertTestData(dict1);
 
-        dictPtr = new Dictionary(std::move(dict1));
+        dictPtr = new Engine(std::move(dict1));
 
         isAbsent(dict1, 22);
         isAbsent(dict1, 4);
@@ -474,18 +539,29 @@ BOOST_AUTO_TEST_CASE(MoveConstructorSteals)
     delete dictPtr;
 }
 
+BOOST_AUTO_TEST_CASE_TEMPLATE(MoveConstructorKeepsSize, Engine, Engines)
+{
+    Engine dict1;
+    insertTestData(dict1);
+
+    Engine dict2(std::move(dict1));
+
+    BOOST_CHECK_EQUAL(dict2.size(), 13u);
+    BOOST_CHECK_EQUAL(dict1.size(), 0u);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 ////////////////////////////////////////////////////////////////////////////////
 
 BOOST_AUTO_TEST_SUITE(Copy_Assignment_Tests)
 
-BOOST_AUTO_TEST_CASE(CopyAssignmentFullyCopies)
+BOOST_AUTO_TEST_CASE_TEMPLATE(CopyAssignmentFullyCopies, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2;
+    Engine dict2;
     dict2 = dict1;
 
     isPresent(dict2, 22, "Mary");
@@ -503,12 +579,12 @@ BOOST_AUTO_TEST_CASE(CopyAssignmentFullyCopies)
     isPresent(dict2, -1, "Edward");
 }
 
-BOOST_AUTO_TEST_CASE(CopyAssignmentOverwrites)
+BOOST_AUTO_TEST_CASE_TEMPLATE(CopyAssignmentOverwrites, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2;
+    Engine dict2;
     dict2.insert(22, "Jane");
     dict2.insert(2, "William");
 
@@ -531,12 +607,12 @@ BOOST_AUTO_TEST_CASE(CopyAssignmentOverwrites)
     isPresent(dict1, 22, "Jane");
 }
 
-BOOST_AUTO_TEST_CASE(CopyAssignmentDoesNotReverseCopy)
+BOOST_AUTO_TEST_CASE_TEMPLATE(CopyAssignmentDoesNotReverseCopy, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2;
+    Engine dict2;
 
     dict2.insert(22, "Jane");
     dict2.insert(2, "William");
@@ -546,12 +622,12 @@ BOOST_AUTO_TEST_CASE(CopyAssignmentDoesNotReverseCopy)
     isAbsent(dict1, 2);
 }
 
-BOOST_AUTO_TEST_CASE(CopyAssignmentIsDeep)
+BOOST_AUTO_TEST_CASE_TEMPLATE(CopyAssignmentIsDeep, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2;
+    Engine dict2;
     dict2 = dict1;
 
     dict1.insert(2, "William");
@@ -571,9 +647,9 @@ BOOST_AUTO_TEST_CASE(CopyAssignmentIsDeep)
     isPresent(dict1, 26, "Charles");
 }
 
-BOOST_AUTO_TEST_CASE(CopySelfAssignment)
+BOOST_AUTO_TEST_CASE_TEMPLATE(CopySelfAssignment, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     dict = dict;
@@ -588,12 +664,12 @@ BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(Move_Assignment_Tests)
 
-BOOST_AUTO_TEST_CASE(MoveAssignmentFullyMoves)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MoveAssignmentFullyMoves, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2;
+    Engine dict2;
     dict2 = std::move(dict1);
 
     isPresent(dict2, 22, "Mary");
@@ -611,9 +687,9 @@ BOOST_AUTO_TEST_CASE(MoveAssignmentFullyMoves)
     isPresent(dict2, -1, "Edward");
 }
 
-BOOST_AUTO_TEST_CASE(MoveAssignmentSteals)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MoveAssignmentSteals, Engine, Engines)
 {
-    Dictionary dict1, dict2;
+    Engine dict1, dict2;
     insertTestData(dict1);
 
     dict2 = std::move(dict1);
@@ -633,12 +709,12 @@ BOOST_AUTO_TEST_CASE(MoveAssignmentSteals)
     isAbsent(dict1, -1);
 }
 
-BOOST_AUTO_TEST_CASE(MoveAssignmentOverwrites)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MoveAssignmentOverwrites, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2;
+    Engine dict2;
     dict2.insert(22, "Jane");
     dict2.insert(2, "William");
 
@@ -660,12 +736,12 @@ BOOST_AUTO_TEST_CASE(MoveAssignmentOverwrites)
     isPresent(dict1, 2, "William");
 }
 
-BOOST_AUTO_TEST_CASE(MoveAssignmentIsNotShallowCopy)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MoveAssignmentIsNotShallowCopy, Engine, Engines)
 {
-    Dictionary dict1;
+    Engine dict1;
     insertTestData(dict1);
 
-    Dictionary dict2;
+    Engine dict2;
     dict2 = std::move(dict1);
 
     dict1.remove(19);
@@ -674,9 +750,9 @@ BOOST_AUTO_TEST_CASE(MoveAssignmentIsNotShallowCopy)
     isPresent(dict2, 23, "Elizabeth");
 }
 
-BOOST_AUTO_TEST_CASE(MoveSelfAssignment)
+BOOST_AUTO_TEST_CASE_TEMPLATE(MoveSelfAssignment, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     dict = std::move(dict);
@@ -691,9 +767,9 @@ BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(RemoveIf_Tests)
 
-BOOST_AUTO_TEST_CASE(RemoveNone)
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveNone, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     dict.removeIf([](int k) {return false; });
@@ -713,9 +789,9 @@ BOOST_AUTO_TEST_CASE(RemoveNone)
     isPresent(dict, -1, "Edward");
 }
 
-BOOST_AUTO_TEST_CASE(RemoveAll)
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveAll, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     dict.removeIf([](int k) {return true; });
@@ -735,9 +811,9 @@ BOOST_AUTO_TEST_CASE(RemoveAll)
     isAbsent(dict, -1);
 }
 
-BOOST_AUTO_TEST_CASE(RemoveOddKeys)
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveOddKeys, Engine, Engines)
 {
-    Dictionary dict;
+    Engine dict;
     insertTestData(dict);
 
     dict.removeIf([](int k) {return k % 2 != 0; });
@@ -758,6 +834,2056 @@ BOOST_AUTO_TEST_CASE(RemoveOddKeys)
     isAbsent(dict, -1);
 }
 
+BOOST_AUTO_TEST_CASE_TEMPLATE(RemoveByItem, Engine, Engines)
+{
+    Engine dict;
+    insertTestData(dict);
+
+    dict.removeIf([](int k, const std::string& item) {return item == "Edward" || (item == "Elizabeth" && k > 30); });
+
+    isPresent(dict, 22, "Mary");
+    isPresent(dict, 23, "Elizabeth");
+    isPresent(dict, 1, "William");
+
+    isAbsent(dict, 9);
+    isAbsent(dict, -1);
+    isAbsent(dict, 42);
+    BOOST_CHECK_EQUAL(dict.size(), 10u);
+}
+
+BOOST_AUTO_TEST_CASE(ParallelRemoveByItem)
+{
+    Dictionary dict;
+    insertTestData(dict);
+
+    dict.removeIfParallel([](int k, const std::string& item) {return item == "Edward" || (item == "Elizabeth" && k > 30); }, 4);
+
+    isPresent(dict, 22, "Mary");
+    isPresent(dict, 23, "Elizabeth");
+    isPresent(dict, 1, "William");
+
+    isAbsent(dict, 9);
+    isAbsent(dict, -1);
+    isAbsent(dict, 42);
+    BOOST_CHECK_EQUAL(dict.size(), 10u);
+}
+
+// The parallel variant rebuilds the tree, so check it against a reference
+// with the cache, filter and hash index all holding nodes.
+BOOST_AUTO_TEST_CASE(ParallelMatchesReference)
+{
+    Dictionary dict;
+    dict.enableLookupCache(256);
+    dict.enableMembershipFilter(20000, 0.01);
+    dict.enableHashIndex();
+    std::map<int, std::string> reference;
+    std::mt19937 rng(34);
+    for (int i = 0; i < 20000; ++i) {
+        int k = static_cast<int>(rng() % 50000);
+        std::string item = std::to_string(rng() % 10);
+        dict.insert(k, item);
+        reference[k] = item;
+    }
+    for (int k = 0; k < 50000; k += 7) {
+        dict.lookup(k); // Populate the cache
+    }
+
+    auto predicate = [](int k, const std::string& item) { return item == "3" || k % 5 == 0; };
+    dict.removeIfParallel(predicate, 3);
+    for (auto it = reference.begin(); it != reference.end();) {
+        it = predicate(it->first, it->second) ? reference.erase(it) : std::next(it);
+    }
+
+    BOOST_CHECK_EQUAL(dict.size(), reference.size());
+    for (int k = 0; k < 50000; ++k) {
+        auto expected = reference.find(k);
+        if (expected == reference.end()) {
+            isAbsent(dict, k);
+        }
+        else {
+            isPresent(dict, k, expected->second);
+        }
+    }
+    dict.insert(3, "after"); // The relinked tree still accepts writes
+    isPresent(dict, 3, "after");
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+BOOST_AUTO_TEST_CASE(ParallelRebalances)
+{
+    Dictionary dict;
+    for (int k = 0; k < 1000; ++k) {
+        dict.insert(k, "item"); // Degenerate: a right spine
+    }
+    BOOST_CHECK_EQUAL(dict.height(), 1000u);
+
+    dict.removeIfParallel([](int k, const std::string&) { return k % 2 == 0; }, 2);
+
+    BOOST_CHECK_EQUAL(dict.size(), 500u);
+    BOOST_CHECK_EQUAL(dict.height(), 9u); // 2^9 - 1 = 511 >= 500
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+// A throwing predicate, on the caller or on a pool thread, surfaces from
+// the call after every thread has stopped, and leaves the entries alone.
+BOOST_AUTO_TEST_CASE(ParallelPropagatesPredicateExceptions)
+{
+    Dictionary dict;
+    Dictionary reference;
+    for (int k = 0; k < 5000; ++k) {
+        dict.insert(k * 7919 % 5000, "item");
+        reference.insert(k, "item");
+    }
+
+    BOOST_CHECK_THROW(dict.removeIfParallel([](int, const std::string&) -> bool { throw std::runtime_error("caller"); }, 4),
+        std::runtime_error);
+
+    // The caller stalls on its first part so the pool threads take the rest.
+    const std::thread::id caller = std::this_thread::get_id();
+    std::atomic<bool> stalled(false);
+    try {
+        dict.removeIfParallel([&](int, const std::string&) {
+            if (std::this_thread::get_id() != caller) {
+                throw std::runtime_error("helper");
+            }
+            if (!stalled.exchange(true)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            return true;
+        }, 4);
+        BOOST_ERROR("no exception from the pool thread");
+    }
+    catch (const std::runtime_error& error) {
+        BOOST_CHECK_EQUAL(error.what(), std::string("helper"));
+    }
+    BOOST_CHECK_EQUAL(dict.size(), 5000u);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+    BOOST_CHECK(dict.contentEquals(reference));
+
+    // The pool is reusable, including from inside a predicate.
+    Dictionary inner;
+    inner.insert(1, "x");
+    dict.removeIfParallel([&](int k, const std::string&) {
+        if (k == 0) {
+            inner.removeIfParallel([](int, const std::string&) { return true; }, 2);
+        }
+        return k % 2 == 0;
+    }, 4);
+    BOOST_CHECK_EQUAL(dict.size(), 2500u);
+    BOOST_CHECK_EQUAL(inner.size(), 0u);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_SUITE(Lookup_Cache_Tests)
+
+BOOST_AUTO_TEST_CASE(RepeatedLookupHitsCache)
+{
+    Dictionary dict;
+    dict.enableLookupCache(64);
+    insertTestData(dict);
+
+    isPresent(dict, 24, "James");
+    isPresent(dict, 24, "James");
+
+    Dictionary::CacheStats stats = dict.cacheStats();
+    BOOST_CHECK_EQUAL(stats.hits, 1u);
+    BOOST_CHECK_EQUAL(stats.misses, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(CachedOverwriteIsVisible)
+{
+    Dictionary dict;
+    dict.enableLookupCache(64);
+    insertTestData(dict);
+
+    isPresent(dict, 26, "Charles");
+    dict.insert(26, "Oliver");
+    isPresent(dict, 26, "Oliver");
+}
+
+BOOST_AUTO_TEST_CASE(CachedRemoveIsVisible)
+{
+    Dictionary dict;
+    dict.enableLookupCache(64);
+    insertTestData(dict);
+
+    isPresent(dict, 22, "Mary");
+    isPresent(dict, 23, "Elizabeth");
+    dict.remove(22);
+
+    isAbsent(dict, 22);
+    isPresent(dict, 23, "Elizabeth");
+    isPresent(dict, 24, "James");
+}
+
+BOOST_AUTO_TEST_CASE(CachedRemoveIfIsVisible)
+{
+    Dictionary dict;
+    dict.enableLookupCache(64);
+    insertTestData(dict);
+
+    isPresent(dict, 9, "Edward");
+    isPresent(dict, 4, "Stephen");
+    dict.removeIf([](int k) {return k % 2 != 0; });
+
+    isAbsent(dict, 9);
+    isPresent(dict, 4, "Stephen");
+}
+
+BOOST_AUTO_TEST_CASE(CachedAssignmentIsVisible)
+{
+    Dictionary dict1, dict2;
+    dict1.enableLookupCache(64);
+    insertTestData(dict1);
+    dict2.insert(2, "William");
+
+    isPresent(dict1, 24, "James");
+    dict1 = dict2;
+    isAbsent(dict1, 24);
+
+    isPresent(dict1, 2, "William");
+    dict1 = std::move(dict2);
+    isPresent(dict1, 2, "William");
+    isAbsent(dict2, 2);
+}
+
+BOOST_AUTO_TEST_CASE(MovedFromCacheIsCleared)
+{
+    Dictionary dict1;
+    dict1.enableLookupCache(64);
+    insertTestData(dict1);
+    isPresent(dict1, 24, "James");
+
+    Dictionary dict2(std::move(dict1));
+    isAbsent(dict1, 24);
+    isPresent(dict2, 24, "James");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Membership_Filter_Tests)
+
+BOOST_AUTO_TEST_CASE(FilterAnswersAbsentLookups)
+{
+    Dictionary dict;
+    dict.enableMembershipFilter(100, 0.01);
+    insertTestData(dict);
+
+    for (int k = 100; k < 200; ++k) {
+        isAbsent(dict, k);
+    }
+    isPresent(dict, 22, "Mary");
+    isPresent(dict, -1, "Edward");
+
+    Dictionary::FilterStats stats = dict.filterStats();
+    BOOST_CHECK_EQUAL(stats.negatives + stats.falsePositives, 100u);
+    BOOST_CHECK_GT(stats.negatives, 90u);
+}
+
+// Rates outside (0, 1) have no filter size; they are rejected and leave
+// the dictionary unfiltered.
+BOOST_AUTO_TEST_CASE(FilterRejectsInvalidRates)
+{
+    Dictionary dict;
+    insertTestData(dict);
+    for (double rate : { 0.0, -0.5, 1.0, 2.0, std::nan("") }) {
+        BOOST_CHECK_THROW(dict.enableMembershipFilter(100, rate), std::invalid_argument);
+    }
+    BOOST_CHECK_EQUAL(dict.filterStats().counters, 0u);
+    isPresent(dict, 22, "Mary");
+    BOOST_CHECK_NO_THROW(dict.enableMembershipFilter(100, 0.999));
+    isPresent(dict, 22, "Mary");
+}
+
+BOOST_AUTO_TEST_CASE(FilterEnabledAfterInsert)
+{
+    Dictionary dict;
+    insertTestData(dict);
+    dict.enableMembershipFilter(16, 0.01);
+
+    isPresent(dict, 4, "Stephen");
+    isPresent(dict, 42, "Elizabeth");
+    isAbsent(dict, 2);
+}
+
+BOOST_AUTO_TEST_CASE(FilterForgetsRemovedKeys)
+{
+    Dictionary dict;
+    dict.enableMembershipFilter(16, 0.01);
+    insertTestData(dict);
+
+    dict.removeIf([](int k) {return k % 2 != 0; });
+    dict.remove(22);
+
+    isAbsent(dict, 9);
+    isAbsent(dict, 22);
+    isPresent(dict, 4, "Stephen");
+    isPresent(dict, 24, "James");
+    BOOST_CHECK_EQUAL(dict.size(), 5u);
+    BOOST_CHECK_GT(dict.filterStats().negatives, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(FilterRebuildsWhenOutgrown)
+{
+    Dictionary dict;
+    dict.enableMembershipFilter(4, 0.01);
+    for (int k = 0; k < 100; ++k) {
+        dict.insert((k * 37) % 101, "Item");
+    }
+
+    BOOST_CHECK_GT(dict.filterStats().rebuilds, 0u);
+    for (int k = 0; k < 100; ++k) {
+        isPresent(dict, (k * 37) % 101, "Item");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(FilterTravelsWithContents)
+{
+    Dictionary dict1;
+    dict1.enableMembershipFilter(16, 0.01);
+    insertTestData(dict1);
+
+    Dictionary dict2(dict1);
+    isPresent(dict2, 31, "Anne");
+    BOOST_CHECK_EQUAL(dict2.filterStats().counters, dict1.filterStats().counters);
+
+    Dictionary dict3;
+    dict3 = std::move(dict1);
+    isPresent(dict3, 31, "Anne");
+    isAbsent(dict1, 31);
+    BOOST_CHECK_EQUAL(dict1.filterStats().counters, 0u);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
-////////////////////////////////////////////////////////////////////////////////
\ No newline at end of file
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Bounded_Tests)
+
+BOOST_AUTO_TEST_CASE(CapacityEvictsLeastRecentlyUsed)
+{
+    Dictionary dict;
+    dict.setCapacity(3);
+    dict.insert(22, "Mary");
+    dict.insert(4, "Stephen");
+    dict.insert(9, "Edward");
+
+    isPresent(dict, 22, "Mary"); // 4 is now the least recently used
+    dict.insert(37, "Victoria");
+
+    isAbsent(dict, 4);
+    isPresent(dict, 22, "Mary");
+    isPresent(dict, 9, "Edward");
+    isPresent(dict, 37, "Victoria");
+    BOOST_CHECK_EQUAL(dict.size(), 3u);
+    BOOST_CHECK_EQUAL(dict.evictionStats().evictions, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(OverwriteRefreshesRecency)
+{
+    Dictionary dict;
+    dict.setCapacity(2);
+    dict.insert(22, "Jane");
+    dict.insert(4, "Matilda");
+    dict.insert(22, "Mary");
+    dict.insert(26, "Oliver");
+
+    isAbsent(dict, 4);
+    isPresent(dict, 22, "Mary");
+    isPresent(dict, 26, "Oliver");
+}
+
+BOOST_AUTO_TEST_CASE(SetCapacityEvictsExistingEntries)
+{
+    Dictionary dict;
+    insertTestData(dict);
+    dict.setCapacity(5);
+
+    BOOST_CHECK_EQUAL(dict.size(), 5u);
+    BOOST_CHECK_EQUAL(dict.evictionStats().evictions, 8u);
+    isPresent(dict, 42, "Elizabeth");
+    isAbsent(dict, -1);
+}
+
+BOOST_AUTO_TEST_CASE(ByteBudgetEvicts)
+{
+    Dictionary dict;
+    dict.insert(1, "William");
+    std::size_t oneEntry = dict.evictionStats().bytes;
+    dict.setCapacity(0, 2 * oneEntry);
+
+    dict.insert(2, "William");
+    dict.insert(3, "William");
+
+    isAbsent(dict, 1);
+    isPresent(dict, 2, "William");
+    isPresent(dict, 3, "William");
+    BOOST_CHECK_LE(dict.evictionStats().bytes, 2 * oneEntry);
+}
+
+BOOST_AUTO_TEST_CASE(ExpiredEntriesAreAbsent)
+{
+    Dictionary dict;
+    dict.insert(22, "Mary", std::chrono::hours(1));
+    dict.insert(4, "Stephen", std::chrono::seconds(0));
+    dict.insert(9, "Edward", std::chrono::seconds(0));
+
+    isPresent(dict, 22, "Mary");
+    isAbsent(dict, 4);
+    dict.removeExpired();
+    isAbsent(dict, 9);
+    BOOST_CHECK_EQUAL(dict.size(), 1u);
+    BOOST_CHECK_EQUAL(dict.evictionStats().expirations, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(InsertWithoutTtlClearsExpiry)
+{
+    Dictionary dict;
+    dict.insert(4, "Matilda", std::chrono::seconds(0));
+    dict.insert(4, "Stephen");
+
+    isPresent(dict, 4, "Stephen");
+    BOOST_CHECK_EQUAL(dict.removeExpired(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(CopyKeepsRecencyOrder)
+{
+    Dictionary dict1;
+    dict1.setCapacity(3);
+    dict1.insert(22, "Mary");
+    dict1.insert(4, "Stephen");
+    dict1.insert(9, "Edward");
+    isPresent(dict1, 22, "Mary");
+
+    Dictionary dict2(dict1);
+    dict2.insert(37, "Victoria");
+    isAbsent(dict2, 4);
+    isPresent(dict1, 4, "Stephen");
+
+    Dictionary dict3;
+    dict3 = std::move(dict1);
+    dict3.insert(37, "Victoria");
+    isAbsent(dict3, 9);
+    isPresent(dict3, 4, "Stephen");
+}
+
+BOOST_AUTO_TEST_CASE(MoveConstructorCarriesAccounting)
+{
+    Dictionary dict1;
+    dict1.setCapacity(3);
+    dict1.insert(22, "Mary");
+    dict1.insert(4, "Stephen");
+    dict1.insert(9, "Edward");
+    std::size_t bytes = dict1.evictionStats().bytes;
+
+    Dictionary dict2(std::move(dict1));
+    BOOST_CHECK_EQUAL(dict2.size(), 3u);
+    BOOST_CHECK_EQUAL(dict2.evictionStats().bytes, bytes);
+    BOOST_CHECK_EQUAL(dict1.size(), 0u);
+    BOOST_CHECK_EQUAL(dict1.evictionStats().bytes, 0u);
+
+    dict2.insert(37, "Victoria"); // Still at the limit, so 22 goes
+    BOOST_CHECK_EQUAL(dict2.size(), 3u);
+    isAbsent(dict2, 22);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Hash_Index_Tests)
+
+BOOST_AUTO_TEST_CASE(IndexedLookupPresentAndAbsent)
+{
+    Dictionary dict;
+    dict.enableHashIndex();
+    insertTestData(dict);
+
+    isPresent(dict, 22, "Mary");
+    isPresent(dict, 4, "Stephen");
+    isPresent(dict, -1, "Edward");
+    isAbsent(dict, 2);
+    isAbsent(dict, 56);
+}
+
+BOOST_AUTO_TEST_CASE(IndexEnabledAfterInsert)
+{
+    Dictionary dict;
+    insertTestData(dict);
+    dict.enableHashIndex();
+
+    isPresent(dict, 26, "Charles");
+    dict.remove(22);
+    isAbsent(dict, 22);
+    isPresent(dict, 23, "Elizabeth");
+}
+
+BOOST_AUTO_TEST_CASE(IndexAgreesWithMapUnderChurn)
+{
+    Dictionary dict;
+    dict.enableHashIndex();
+    std::map<int, std::string> oracle;
+    std::mt19937 rng(29);
+    std::uniform_int_distribution<int> keys(0, 300);
+
+    for (int step = 0; step < 5000; ++step) {
+        int k = keys(rng);
+        if (rng() % 3 == 0) {
+            dict.remove(k);
+            oracle.erase(k);
+        }
+        else {
+            dict.insert(k, std::to_string(step));
+            oracle[k] = std::to_string(step);
+        }
+    }
+
+    for (int k = 0; k <= 300; ++k) {
+        auto it = oracle.find(k);
+        if (it == oracle.end()) {
+            isAbsent(dict, k);
+        }
+        else {
+            isPresent(dict, k, it->second);
+        }
+    }
+    BOOST_CHECK_LE(dict.hashIndexStats().loadFactor, 0.5);
+}
+
+BOOST_AUTO_TEST_CASE(IndexTravelsWithContents)
+{
+    Dictionary dict1;
+    dict1.enableHashIndex();
+    insertTestData(dict1);
+
+    Dictionary dict2(dict1);
+    dict1.remove(24);
+    isPresent(dict2, 24, "James");
+    isAbsent(dict1, 24);
+
+    Dictionary dict3;
+    dict3.insert(2, "William");
+    dict3 = std::move(dict2);
+    isPresent(dict3, 24, "James");
+    isAbsent(dict3, 2);
+    isAbsent(dict2, 24);
+    BOOST_CHECK_GT(dict3.hashIndexStats().slots, 0u);
+    BOOST_CHECK_EQUAL(dict2.hashIndexStats().slots, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Radix_Engine_Tests)
+
+BOOST_AUTO_TEST_CASE(ExtremeKeys)
+{
+    RadixDictionary dict;
+    dict.insert(2147483647, "Max");
+    dict.insert(-2147483647 - 1, "Min");
+    dict.insert(0, "Zero");
+    dict.insert(-1, "MinusOne");
+
+    isPresent(dict, 2147483647, "Max");
+    isPresent(dict, -2147483647 - 1, "Min");
+    isPresent(dict, 0, "Zero");
+    isPresent(dict, -1, "MinusOne");
+    isAbsent(dict, 1);
+    BOOST_CHECK_EQUAL(dict.size(), 4u);
+}
+
+BOOST_AUTO_TEST_CASE(DenseRangeRoundTrip)
+{
+    RadixDictionary dict;
+    for (int k = -1000; k < 1000; ++k) {
+        dict.insert(k, std::to_string(k));
+    }
+    dict.removeIf([](int k) {return k % 3 == 0; });
+    for (int k = -1000; k < 1000; k += 2) {
+        dict.remove(k);
+    }
+
+    for (int k = -1000; k < 1000; ++k) {
+        if (k % 3 == 0 || k % 2 == 0) {
+            isAbsent(dict, k);
+        }
+        else {
+            isPresent(dict, k, std::to_string(k));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RemovingEverythingFreesTheTrie)
+{
+    RadixDictionary dict;
+    insertTestData(dict);
+    dict.removeIf([](int) { return true; });
+    BOOST_CHECK_EQUAL(dict.size(), 0u);
+
+    dict.insert(7, "John");
+    isPresent(dict, 7, "John");
+}
+
+// Nodes emptied before a predicate throws are still freed; displayTree
+// prints each node's child count, so an empty one would show up as 0.
+BOOST_AUTO_TEST_CASE(ThrowingPredicatePrunesEmptiedNodes)
+{
+    RadixDictionary dict;
+    for (int k = 0; k < 10; ++k) {
+        dict.insert(k, "Low");          // One leaf
+        dict.insert(70000 + k, "High"); // Another leaf, under another Level2 node
+    }
+    BOOST_CHECK_THROW(dict.removeIf([](int k) {
+        if (k >= 70005) {
+            throw std::runtime_error("predicate failed");
+        }
+        return true;
+    }), std::runtime_error);
+
+    BOOST_CHECK_EQUAL(dict.size(), 5u);
+    isAbsent(dict, 0);
+    isAbsent(dict, 70004);
+    isPresent(dict, 70005, "High");
+
+    std::ostringstream tree;
+    std::streambuf* console = std::cout.rdbuf(tree.rdbuf());
+    dict.displayTree();
+    std::cout.rdbuf(console);
+    BOOST_CHECK(tree.str().find("Children: 0") == std::string::npos);
+    BOOST_CHECK(tree.str().find("Children: 5\n") != std::string::npos);
+
+    dict.removeIf([](int) { return true; }); // The trie still drains and frees
+    BOOST_CHECK_EQUAL(dict.size(), 0u);
+    dict.insert(7, "John");
+    isPresent(dict, 7, "John");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Compact_Engine_Tests)
+
+BOOST_AUTO_TEST_CASE(RemovedSlotsAreReused)
+{
+    CompactDictionary dict;
+    for (int k = 0; k < 100; ++k) {
+        dict.insert(k, std::to_string(k));
+    }
+    std::size_t indexBytes = dict.memoryStats().indexBytes;
+
+    dict.removeIf([](int k) {return k % 2 == 0; });
+    for (int k = 100; k < 150; ++k) {
+        dict.insert(k, std::to_string(k));
+    }
+
+    BOOST_CHECK_EQUAL(dict.size(), 100u);
+    BOOST_CHECK_EQUAL(dict.memoryStats().indexBytes, indexBytes);
+    for (int k = 0; k < 150; ++k) {
+        if (k < 100 && k % 2 == 0) {
+            isAbsent(dict, k);
+        }
+        else {
+            isPresent(dict, k, std::to_string(k));
+        }
+    }
+}
+
+// Items are stored out of line, so growing the index must not move them.
+BOOST_AUTO_TEST_CASE(LookupPointerSurvivesGrowth)
+{
+    CompactDictionary dict;
+    dict.insert(22, "Jane");
+    std::string* item = dict.lookup(22);
+    for (int k = 0; k < 10000; ++k) {
+        dict.insert(k + 100, "filler");
+    }
+    BOOST_CHECK(item == dict.lookup(22));
+    BOOST_CHECK_EQUAL(*item, "Jane");
+}
+
+BOOST_AUTO_TEST_CASE(RemoveNodeWithTwoChildren)
+{
+    CompactDictionary dict;
+    insertTestData(dict);
+    dict.remove(22); // Root with two children
+    dict.remove(4);
+
+    isAbsent(dict, 22);
+    isAbsent(dict, 4);
+    isPresent(dict, 24, "James");
+    isPresent(dict, 23, "Elizabeth");
+    isPresent(dict, 0, "Harold");
+    BOOST_CHECK_EQUAL(dict.size(), 11u);
+}
+
+// A copy duplicates the arena including its free slots; both sides must
+// then evolve independently.
+BOOST_AUTO_TEST_CASE(CopyWithFreeSlotsIsIndependent)
+{
+    CompactDictionary original;
+    insertTestData(original);
+    original.remove(22);
+    original.remove(9);
+
+    CompactDictionary copy(original);
+    copy.insert(50, "Copy"); // Reuses a free slot
+    original.insert(60, "Original");
+    copy.remove(0);
+
+    isPresent(copy, 50, "Copy");
+    isAbsent(copy, 60);
+    isAbsent(copy, 0);
+    isPresent(original, 60, "Original");
+    isAbsent(original, 50);
+    isPresent(original, 0, "Harold");
+    BOOST_CHECK_EQUAL(copy.size(), 11u);
+    BOOST_CHECK_EQUAL(original.size(), 12u);
+
+    copy = copy; // Self-assignment keeps the contents
+    isPresent(copy, 50, "Copy");
+    copy = original;
+    isPresent(copy, 0, "Harold");
+    isAbsent(copy, 50);
+}
+
+BOOST_AUTO_TEST_CASE(ReserveBeyondIndexRangeThrows)
+{
+    CompactDictionary dict;
+    BOOST_CHECK_THROW(dict.reserve(CompactDictionary::maxEntries + std::size_t(1)), std::length_error);
+    dict.reserve(1000);
+    BOOST_CHECK_EQUAL(dict.memoryStats().indexBytes, 12000u);
+}
+
+// A failed insert leaves the index and value store in step and the free
+// list intact, whichever allocation fails.
+BOOST_AUTO_TEST_CASE(FailedInsertLeavesArenaConsistent)
+{
+    CompactDictionary dict;
+    dict.reserve(3);
+    std::string item(100, 'x');
+    dict.insert(1, "one");
+    dict.insert(2, "two");
+    dict.insert(3, "three");
+
+    dict.remove(2);
+    std::size_t indexBytes = dict.memoryStats().indexBytes;
+    failAllocation(item.size() + 1); // Copying the item into the free slot
+    BOOST_CHECK_THROW(dict.insert(7, item), std::bad_alloc);
+    dict.insert(7, "seven"); // Still reuses the free slot rather than growing
+    BOOST_CHECK_EQUAL(dict.memoryStats().indexBytes, indexBytes);
+
+    failAllocation(item.size() + 1); // Copying the item into a new slot
+    BOOST_CHECK_THROW(dict.insert(4, item), std::bad_alloc);
+    dict.insert(4, "four");
+    dict.insert(5, "five");
+    dict.insert(6, "six"); // The index is full again at 6 nodes
+
+    failAllocation(12 * 12); // Growing the index to 12 nodes of 12 bytes
+    BOOST_CHECK_THROW(dict.insert(8, "eight"), std::bad_alloc);
+    dict.insert(9, "nine");
+
+    BOOST_CHECK_EQUAL(dict.size(), 7u);
+    isAbsent(dict, 2);
+    isAbsent(dict, 8);
+    isPresent(dict, 1, "one");
+    isPresent(dict, 3, "three");
+    isPresent(dict, 4, "four");
+    isPresent(dict, 5, "five");
+    isPresent(dict, 6, "six");
+    isPresent(dict, 7, "seven");
+    isPresent(dict, 9, "nine");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Frozen_Tests)
+
+const FrozenDictionary::Layout frozenLayouts[] = {
+    FrozenDictionary::Layout::Sorted, FrozenDictionary::Layout::Eytzinger, FrozenDictionary::Layout::VanEmdeBoas,
+    FrozenDictionary::Layout::Packed,
+};
+
+// Sizes around powers of two exercise complete and ragged last levels.
+BOOST_AUTO_TEST_CASE(EveryLayoutMatchesSource)
+{
+    const std::size_t sizes[] = { 0, 1, 2, 3, 7, 8, 9, 100, 1023, 1024, 5000 };
+    for (std::size_t n : sizes) {
+        Dictionary source;
+        int end = 2 * static_cast<int>(n) - 1000;
+        for (int k = -1000; k < end; k += 2) { // Odd keys in between are misses
+            source.insert(k, std::to_string(k));
+        }
+        for (FrozenDictionary::Layout layout : frozenLayouts) {
+            FrozenDictionary frozen(source, layout, false);
+            BOOST_CHECK_EQUAL(frozen.size(), n);
+            for (int k = -1002; k < end + 2; ++k) {
+                const std::string* item = frozen.lookup(k);
+                if (k >= -1000 && k < end && k % 2 == 0) {
+                    BOOST_REQUIRE_MESSAGE(item != nullptr, std::to_string(k) + " is missing");
+                    BOOST_CHECK_EQUAL(*item, std::to_string(k));
+                }
+                else {
+                    BOOST_CHECK(item == nullptr);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ExtremeKeysAndHugePages)
+{
+    Dictionary source;
+    source.insert(2147483647, "Max");
+    source.insert(-2147483647 - 1, "Min");
+    insertTestData(source);
+    for (FrozenDictionary::Layout layout : frozenLayouts) {
+        FrozenDictionary frozen(source, layout); // Huge pages if the system grants them
+        BOOST_CHECK(*frozen.lookup(2147483647) == "Max");
+        BOOST_CHECK(*frozen.lookup(-2147483647 - 1) == "Min");
+        BOOST_CHECK(*frozen.lookup(22) == "Mary");
+        BOOST_CHECK(frozen.lookup(2) == nullptr);
+
+        FrozenDictionary plain(source, layout, false);
+        BOOST_CHECK(!plain.hugePages()); // Reports the backing, not the request
+        BOOST_CHECK(*plain.lookup(22) == "Mary");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RebuildPicksUpChanges)
+{
+    Dictionary source;
+    insertTestData(source);
+    FrozenDictionary frozen(source, FrozenDictionary::Layout::VanEmdeBoas);
+
+    source.remove(22);
+    source.insert(7, "John");
+    BOOST_CHECK(*frozen.lookup(22) == "Mary"); // Frozen until rebuilt
+    frozen.rebuild(source);
+
+    BOOST_CHECK(frozen.lookup(22) == nullptr);
+    BOOST_CHECK(*frozen.lookup(7) == "John");
+    BOOST_CHECK_EQUAL(frozen.size(), source.size());
+}
+
+BOOST_AUTO_TEST_CASE(FailedRebuildKeepsOldLayout)
+{
+    Dictionary source;
+    insertTestData(source);
+    FrozenDictionary frozen(source, FrozenDictionary::Layout::Eytzinger);
+
+    for (int k = 100; k < 107; ++k) {
+        source.insert(k, "Later");
+    }
+    failAllocation(20 * sizeof(std::string), 1); // Not the copied items, but the laid-out ones
+    BOOST_CHECK_THROW(frozen.rebuild(source), std::bad_alloc);
+
+    BOOST_CHECK_EQUAL(frozen.size(), 13u);
+    BOOST_CHECK(*frozen.lookup(22) == "Mary");
+    BOOST_CHECK(*frozen.lookup(-1) == "Edward");
+    BOOST_CHECK(frozen.lookup(100) == nullptr);
+
+    frozen.rebuild(source);
+    BOOST_CHECK_EQUAL(frozen.size(), 20u);
+    BOOST_CHECK(*frozen.lookup(100) == "Later");
+}
+
+// Blocks mixing dense runs, random gaps and full 32-bit gaps, checked
+// against the source; dense runs must pack to no more than the block headers.
+BOOST_AUTO_TEST_CASE(PackedMixedGaps)
+{
+    Dictionary source;
+    std::map<int, std::string> reference;
+    std::mt19937 rng(43);
+    for (int k = 0; k < 3000; ++k) {
+        reference[k] = "dense";
+    }
+    for (int i = 0; i < 3000; ++i) {
+        reference[static_cast<int>(rng())] = "sparse";
+    }
+    reference[2147483647] = "Max";
+    reference[-2147483647 - 1] = "Min";
+    for (const auto& entry : reference) {
+        source.insert(entry.first, entry.second);
+    }
+
+    FrozenDictionary packed(source, FrozenDictionary::Layout::Packed, false);
+    BOOST_CHECK_EQUAL(packed.size(), reference.size());
+    for (const auto& entry : reference) {
+        const std::string* item = packed.lookup(entry.first);
+        BOOST_REQUIRE_MESSAGE(item != nullptr, std::to_string(entry.first) + " is missing");
+        BOOST_CHECK_EQUAL(*item, entry.second);
+        if (entry.first != 2147483647 && reference.count(entry.first + 1) == 0) {
+            BOOST_CHECK(packed.lookup(entry.first + 1) == nullptr);
+        }
+    }
+
+    Dictionary dense;
+    for (int k = 0; k < 128 * 100; ++k) {
+        dense.insert(k * 37 % 12800, "x");
+    }
+    FrozenDictionary packedDense(dense, FrozenDictionary::Layout::Packed, false);
+    BOOST_CHECK_LE(packedDense.bufferBytes() * 8.0 / packedDense.size(), 1.0); // Block headers only
+}
+
+// Blocks of evenly spaced keys own no words, so the buffer ends exactly where
+// the words would start: 256 keys leave it at the block headers, and 32768
+// keys put that end on a 4 KiB page boundary.
+BOOST_AUTO_TEST_CASE(PackedZeroWidthBlocksAtBufferEnd)
+{
+    for (int n : { 1, 128, 129, 256, 32768 }) {
+        for (int step : { 1, 3 }) {
+            Dictionary source;
+            for (int i = 0; i < n; ++i) {
+                source.insert((i * 7919) % n * step, "x");
+            }
+            FrozenDictionary packed(source, FrozenDictionary::Layout::Packed, false);
+            std::size_t blocks = (n + 127) / 128;
+            std::size_t headersAt = (blocks * sizeof(int) + 7) / 8 * 8;
+            BOOST_CHECK_EQUAL(packed.bufferBytes(), (headersAt + blocks * 12 + 7) / 8 * 8); // No words
+            for (int k = -1; k <= n * step; ++k) {
+                bool present = k >= 0 && k < n * step && k % step == 0;
+                BOOST_REQUIRE_MESSAGE((packed.lookup(k) != nullptr) == present, std::to_string(k) + " of " + std::to_string(n));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Static_Tests)
+
+// The same sequence as insertTestData, including the overwrites.
+constexpr StaticEntry staticTestData[] = {
+    { 22, "Jane" }, { 22, "Mary" }, { 0, "Harold" }, { 9, "Edward" },
+    { 37, "Victoria" }, { 4, "Matilda" }, { 26, "Oliver" }, { 42, "Elizabeth" },
+    { 19, "Henry" }, { 4, "Stephen" }, { 24, "James" }, { -1, "Edward" },
+    { 31, "Anne" }, { 23, "Elizabeth" }, { 1, "William" }, { 26, "Charles" },
+};
+constexpr StaticDictionary staticTable(staticTestData);
+
+// Built and searched entirely at compile time.
+static_assert(staticTable.size() == 13, "duplicate keys collapse");
+static_assert(*staticTable.lookup(22) == "Mary", "the last entry for a key wins");
+static_assert(staticTable.lookup(2) == nullptr, "absent keys are not found");
+
+BOOST_AUTO_TEST_CASE(MatchesDictionary)
+{
+    Dictionary dict;
+    insertTestData(dict);
+
+    BOOST_CHECK_EQUAL(staticTable.size(), dict.size());
+    for (int k = -5; k < 50; ++k) {
+        const std::string_view* item = staticTable.lookup(k);
+        std::string* expected = dict.lookup(k);
+        BOOST_CHECK_EQUAL(item == nullptr, expected == nullptr);
+        if (item != nullptr && expected != nullptr) {
+            BOOST_CHECK(*item == *expected);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EmptyAndSingleTables)
+{
+    static constexpr StaticEntry one[] = { { 5, "five" } };
+    static constexpr StaticDictionary single(one);
+    BOOST_CHECK_EQUAL(single.size(), 1u);
+    BOOST_CHECK(*single.lookup(5) == "five");
+    BOOST_CHECK(single.lookup(4) == nullptr);
+
+    static constexpr std::array<StaticEntry, 0> none{};
+    static constexpr StaticDictionary empty(none);
+    BOOST_CHECK_EQUAL(empty.size(), 0u);
+    BOOST_CHECK(empty.lookup(5) == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Versioned_Tests)
+
+BOOST_AUTO_TEST_CASE(SnapshotIsPointInTime)
+{
+    VersionedDictionary dict;
+    insertTestData(dict);
+    VersionedDictionary::Snapshot before = dict.snapshot();
+
+    dict.remove(22);
+    dict.insert(2, "William");
+    dict.insert(4, "Matilda");
+
+    BOOST_CHECK(before.lookup(22) != nullptr && *before.lookup(22) == "Mary");
+    BOOST_CHECK(before.lookup(2) == nullptr);
+    BOOST_CHECK(*before.lookup(4) == "Stephen");
+    BOOST_CHECK_EQUAL(before.size(), 13u);
+
+    std::string item;
+    BOOST_CHECK(!dict.lookup(22, item));
+    BOOST_CHECK(dict.lookup(4, item) && item == "Matilda");
+    BOOST_CHECK_EQUAL(dict.size(), 13u);
+    BOOST_CHECK_GT(dict.snapshot().version(), before.version());
+}
+
+BOOST_AUTO_TEST_CASE(SnapshotScansInKeyOrder)
+{
+    VersionedDictionary dict;
+    insertTestData(dict);
+    dict.removeIf([](int k) {return k % 2 != 0; });
+
+    std::vector<int> keys;
+    dict.snapshot().forEach([&](int k, const std::string&) { keys.push_back(k); });
+
+    std::vector<int> expected = { 0, 4, 22, 24, 26, 42 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(keys.begin(), keys.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(ReplacedNodesReclaimedAfterSnapshotCloses)
+{
+    VersionedDictionary dict;
+    insertTestData(dict);
+    dict.reclaim();
+    BOOST_CHECK_EQUAL(dict.gcStats().retiredNodes, 0u);
+
+    {
+        VersionedDictionary::Snapshot view = dict.snapshot();
+        dict.remove(26);
+        dict.insert(3, "Henry");
+        BOOST_CHECK_GT(dict.gcStats().retiredNodes, 0u);
+        BOOST_CHECK_EQUAL(dict.gcStats().activeSnapshots, 1u);
+        BOOST_CHECK(*view.lookup(26) == "Charles");
+    }
+
+    dict.reclaim();
+    BOOST_CHECK_EQUAL(dict.gcStats().retiredNodes, 0u);
+    BOOST_CHECK_EQUAL(dict.gcStats().activeSnapshots, 0u);
+}
+
+// Writers churn disjoint key sets while scanners repeatedly walk whole
+// snapshots; every scan must be sorted, self-consistent and match its size.
+BOOST_AUTO_TEST_CASE(ConcurrentWritersAndLongScans)
+{
+    VersionedDictionary dict;
+    const int writers = 2, scanners = 3, opsPerWriter = 20000, keySpace = 2000;
+    std::atomic<bool> done(false);
+    std::atomic<int> badScans(0), scans(0);
+
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; ++w) {
+        threads.emplace_back([&, w] {
+            std::mt19937 rng(31 + w);
+            std::uniform_int_distribution<int> keys(0, keySpace - 1);
+            for (int op = 0; op < opsPerWriter; ++op) {
+                int k = keys(rng) * writers + w;
+                if (rng() % 3 == 0) {
+                    dict.remove(k);
+                }
+                else {
+                    dict.insert(k, std::to_string(k));
+                }
+            }
+        });
+    }
+    for (int r = 0; r < scanners; ++r) {
+        threads.emplace_back([&] {
+            while (!done.load()) {
+                VersionedDictionary::Snapshot view = dict.snapshot();
+                std::size_t seen = 0;
+                int previous = -1;
+                bool ok = true;
+                view.forEach([&](int k, const std::string& item) {
+                    ok = ok && k > previous && item == std::to_string(k);
+                    previous = k;
+                    ++seen;
+                });
+                if (!ok || seen != view.size()) {
+                    ++badScans;
+                }
+                ++scans;
+            }
+        });
+    }
+
+    for (int w = 0; w < writers; ++w) {
+        threads[w].join();
+    }
+    done.store(true);
+    for (std::size_t t = writers; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    BOOST_CHECK_EQUAL(badScans.load(), 0);
+    BOOST_CHECK_GT(scans.load(), 0);
+    dict.reclaim();
+    BOOST_CHECK_EQUAL(dict.gcStats().retiredNodes, 0u);
+}
+
+// size() takes no snapshot, so it must stay safe while writers publish and
+// free superseded versions underneath it.
+BOOST_AUTO_TEST_CASE(SizeDuringConcurrentWrites)
+{
+    VersionedDictionary dict;
+    const int writers = 2, readers = 2, opsPerWriter = 20000, keySpace = 500;
+    std::atomic<bool> done(false);
+    std::atomic<int> outOfRange(0), reads(0);
+
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; ++w) {
+        threads.emplace_back([&, w] {
+            std::mt19937 rng(47 + w);
+            std::uniform_int_distribution<int> keys(0, keySpace - 1);
+            for (int op = 0; op < opsPerWriter; ++op) {
+                int k = keys(rng);
+                if (rng() % 2 == 0) {
+                    dict.remove(k);
+                }
+                else {
+                    dict.insert(k, "x");
+                }
+            }
+        });
+    }
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&] {
+            while (!done.load()) {
+                if (dict.size() > static_cast<std::size_t>(keySpace)) {
+                    ++outOfRange;
+                }
+                ++reads;
+            }
+        });
+    }
+
+    for (int w = 0; w < writers; ++w) {
+        threads[w].join();
+    }
+    done.store(true);
+    for (std::size_t t = writers; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    BOOST_CHECK_EQUAL(outOfRange.load(), 0);
+    BOOST_CHECK_GT(reads.load(), 0);
+    BOOST_CHECK_EQUAL(dict.size(), dict.snapshot().size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Lock_Free_Tests)
+
+BOOST_AUTO_TEST_CASE(InsertLookupRemove)
+{
+    LockFreeDictionary dict;
+    std::string item;
+    BOOST_CHECK(!dict.lookup(22, item));
+
+    dict.insert(22, "Jane");
+    dict.insert(-4, "Mary");
+    dict.insert(22, "Harold"); // Overwrite
+    BOOST_CHECK_EQUAL(dict.size(), 2u);
+    BOOST_CHECK(dict.lookup(22, item) && item == "Harold");
+    BOOST_CHECK(dict.lookup(-4, item) && item == "Mary");
+
+    dict.remove(22);
+    dict.remove(99); // Absent
+    BOOST_CHECK(!dict.lookup(22, item));
+    BOOST_CHECK_EQUAL(dict.size(), 1u);
+
+    dict.insert(22, "Anne"); // Re-insert after removal
+    BOOST_CHECK(dict.lookup(22, item) && item == "Anne");
+}
+
+BOOST_AUTO_TEST_CASE(RemoveIfMatchesReference)
+{
+    LockFreeDictionary dict;
+    std::map<int, std::string> reference;
+    for (int k = -500; k < 500; ++k) {
+        dict.insert(k, std::to_string(k));
+        reference[k] = std::to_string(k);
+    }
+
+    dict.removeIf([](int k) { return k % 3 == 0; });
+    for (auto it = reference.begin(); it != reference.end();) {
+        it = it->first % 3 == 0 ? reference.erase(it) : std::next(it);
+    }
+
+    BOOST_CHECK_EQUAL(dict.size(), reference.size());
+    std::string item;
+    for (int k = -500; k < 500; ++k) {
+        BOOST_CHECK_EQUAL(dict.lookup(k, item), reference.count(k) == 1);
+    }
+}
+
+// Threads insert disjoint keys, then remove half of them, all concurrently
+// with readers; afterwards exactly the surviving keys must be present.
+BOOST_AUTO_TEST_CASE(ConcurrentDisjointWriters)
+{
+    LockFreeDictionary dict;
+    const int writers = 4, keysPerWriter = 5000;
+    std::atomic<bool> done(false);
+    std::atomic<int> badReads(0);
+
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; ++w) {
+        threads.emplace_back([&, w] {
+            for (int i = 0; i < keysPerWriter; ++i) {
+                int k = i * writers + w;
+                dict.insert(k, std::to_string(k));
+            }
+            for (int i = 0; i < keysPerWriter; i += 2) {
+                dict.remove(i * writers + w);
+            }
+        });
+    }
+    threads.emplace_back([&] {
+        std::mt19937 rng(32);
+        std::string item;
+        while (!done.load()) {
+            int k = static_cast<int>(rng() % (writers * keysPerWriter));
+            if (dict.lookup(k, item) && item != std::to_string(k)) {
+                ++badReads;
+            }
+        }
+    });
+
+    for (int w = 0; w < writers; ++w) {
+        threads[w].join();
+    }
+    done.store(true);
+    threads.back().join();
+
+    BOOST_CHECK_EQUAL(badReads.load(), 0);
+    BOOST_CHECK_EQUAL(dict.size(), static_cast<std::size_t>(writers * keysPerWriter / 2));
+    std::string item;
+    for (int k = 0; k < writers * keysPerWriter; ++k) {
+        BOOST_CHECK_EQUAL(dict.lookup(k, item), (k / writers) % 2 == 1);
+    }
+}
+
+// Threads fight over a small key range so inserts, overwrites and removes
+// of the same key race; afterwards every present key holds its own item
+// and size() agrees with what lookup finds.
+BOOST_AUTO_TEST_CASE(ConcurrentContendedKeys)
+{
+    LockFreeDictionary dict;
+    const int threadsCount = 4, opsPerThread = 20000, keySpace = 64;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadsCount; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(320 + t);
+            std::string item;
+            for (int op = 0; op < opsPerThread; ++op) {
+                int k = static_cast<int>(rng() % keySpace);
+                switch (rng() % 3) {
+                case 0: dict.insert(k, std::to_string(k)); break;
+                case 1: dict.remove(k); break;
+                default: dict.lookup(k, item); break;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::size_t present = 0;
+    std::string item;
+    for (int k = 0; k < keySpace; ++k) {
+        if (dict.lookup(k, item)) {
+            BOOST_CHECK_EQUAL(item, std::to_string(k));
+            ++present;
+        }
+    }
+    BOOST_CHECK_EQUAL(dict.size(), present);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Batched_Writer_Tests)
+
+// One merged pass over a random tree must leave the same contents, filter
+// and hash index as applying the writes one at a time.
+BOOST_AUTO_TEST_CASE(ApplyBatchMatchesKeyByKey)
+{
+    Dictionary dict;
+    dict.enableMembershipFilter(64, 0.01); // Small, so the batch grows it
+    dict.enableHashIndex();
+    std::map<int, std::string> reference;
+    std::mt19937 rng(33);
+    for (int i = 0; i < 2000; ++i) {
+        int k = static_cast<int>(rng() % 4000) - 2000;
+        dict.insert(k, "old");
+        reference[k] = "old";
+    }
+
+    std::vector<Dictionary::BatchWrite> writes;
+    for (int k = -2500; k < 2500; k += 1 + static_cast<int>(rng() % 3)) {
+        bool erase = rng() % 2 == 0;
+        writes.push_back(Dictionary::BatchWrite{ k, erase, erase ? "" : std::to_string(k) });
+        if (erase) {
+            reference.erase(k);
+        }
+        else {
+            reference[k] = std::to_string(k);
+        }
+    }
+    dict.applyBatch(writes);
+
+    BOOST_CHECK_EQUAL(dict.size(), reference.size());
+    for (int k = -2500; k < 2500; ++k) {
+        auto expected = reference.find(k);
+        std::string* item = dict.lookup(k);
+        if (expected == reference.end()) {
+            BOOST_CHECK(item == nullptr);
+        }
+        else {
+            BOOST_REQUIRE(item != nullptr);
+            BOOST_CHECK_EQUAL(*item, expected->second);
+        }
+    }
+    BOOST_CHECK_GT(dict.filterStats().rebuilds, 0u);
+}
+
+// Bounded dictionaries apply key by key, so capacity is still respected.
+BOOST_AUTO_TEST_CASE(ApplyBatchRespectsCapacity)
+{
+    Dictionary dict;
+    dict.setCapacity(10);
+    std::vector<Dictionary::BatchWrite> writes;
+    for (int k = 0; k < 50; ++k) {
+        writes.push_back(Dictionary::BatchWrite{ k, false, "item" });
+    }
+    dict.applyBatch(writes);
+
+    BOOST_CHECK_EQUAL(dict.size(), 10u);
+    BOOST_CHECK(dict.lookup(49) != nullptr);
+    BOOST_CHECK(dict.lookup(0) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(LastWriteWins)
+{
+    Dictionary dict;
+    std::mutex dictLock;
+    {
+        BatchedWriter writer(dict, dictLock);
+        BatchedWriter::Producer& producer = writer.producer();
+        producer.insert(22, "Jane");
+        producer.insert(22, "Mary");
+        producer.insert(7, "Harold");
+        producer.remove(7);
+        producer.remove(5);
+        producer.insert(5, "Anne");
+        writer.flush();
+
+        std::lock_guard<std::mutex> lock(dictLock);
+        isPresent(dict, 22, "Mary");
+        isAbsent(dict, 7);
+        isPresent(dict, 5, "Anne");
+        BOOST_CHECK_EQUAL(writer.stats().writes, 6u);
+    }
+}
+
+// An item that cannot be copied fails the submit before it takes a ticket,
+// so later writes are not held up behind a ticket that never arrives.
+BOOST_AUTO_TEST_CASE(FailedSubmitDoesNotStall)
+{
+    Dictionary dict;
+    std::mutex dictLock;
+    BatchedWriter writer(dict, dictLock);
+    BatchedWriter::Producer& producer = writer.producer();
+    std::string item(5000, 'x');
+
+    failAllocation(item.size() + 1); // The copy into the queued record
+    BOOST_CHECK_THROW(producer.insert(1, item), std::bad_alloc);
+    producer.insert(2, "two");
+    writer.flush();
+
+    std::lock_guard<std::mutex> lock(dictLock);
+    isAbsent(dict, 1);
+    isPresent(dict, 2, "two");
+}
+
+// A batch that throws on the applier thread is reported by the next wait;
+// the applier keeps running and later writes still land.
+BOOST_AUTO_TEST_CASE(ApplierFailureReachesWaiter)
+{
+    Dictionary dict;
+    std::mutex dictLock;
+    BatchedWriter writer(dict, dictLock);
+    BatchedWriter::Producer& producer = writer.producer();
+    std::string item(5000, 'x');
+
+    failAllocation(item.size() + 1, 1); // Not the record's copy, but the node's
+    std::uint64_t ticket = producer.insert(1, item);
+    BOOST_CHECK_THROW(writer.await(ticket), std::bad_alloc);
+    writer.flush(); // Reported once
+
+    writer.await(producer.insert(2, item));
+    std::lock_guard<std::mutex> lock(dictLock);
+    isAbsent(dict, 1);
+    isPresent(dict, 2, item);
+}
+
+BOOST_AUTO_TEST_CASE(AwaitMakesWriteVisible)
+{
+    Dictionary dict;
+    std::mutex dictLock;
+    BatchedWriter writer(dict, dictLock);
+    BatchedWriter::Producer& producer = writer.producer();
+    for (int k = 0; k < 100; ++k) {
+        writer.await(producer.insert(k, std::to_string(k)));
+        std::lock_guard<std::mutex> lock(dictLock);
+        isPresent(dict, k, std::to_string(k));
+    }
+}
+
+// Producers write disjoint keys and then hand one shared key along in
+// turn; tickets must order the hand-offs even across batches.
+BOOST_AUTO_TEST_CASE(ConcurrentProducers)
+{
+    Dictionary dict;
+    std::mutex dictLock;
+    const int producers = 4, keysPerProducer = 5000;
+    {
+        BatchedWriter writer(dict, dictLock);
+        std::atomic<int> turn(0);
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; ++p) {
+            BatchedWriter::Producer& producer = writer.producer();
+            threads.emplace_back([&, p] {
+                for (int i = 0; i < keysPerProducer; ++i) {
+                    producer.insert(i * producers + p, std::to_string(p));
+                }
+                while (turn.load() != p) {
+                    std::this_thread::yield();
+                }
+                producer.insert(-1, std::to_string(p));
+                turn.store(p + 1);
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        writer.flush();
+        BOOST_CHECK_EQUAL(writer.stats().writes, static_cast<std::size_t>(producers * (keysPerProducer + 1)));
+    }
+
+    BOOST_CHECK_EQUAL(dict.size(), static_cast<std::size_t>(producers * keysPerProducer + 1));
+    isPresent(dict, -1, std::to_string(producers - 1));
+    for (int k = 0; k < producers * keysPerProducer; ++k) {
+        isPresent(dict, k, std::to_string(k % producers));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Insert_Cursor_Tests)
+
+BOOST_AUTO_TEST_CASE(CursorMatchesInsert)
+{
+    Dictionary dict;
+    Dictionary::InsertCursor cursor(dict);
+    cursor.insert(22, "Jane");
+    cursor.insert(22, "Mary");
+    cursor.insert(0, "Harold");
+    cursor.insert(9, "Edward");
+    cursor.insert(37, "Victoria");
+    cursor.insert(4, "Matilda");
+    cursor.insert(26, "Oliver");
+    cursor.insert(42, "Elizabeth");
+    cursor.insert(19, "Henry");
+    cursor.insert(4, "Stephen");
+    cursor.insert(24, "James");
+    cursor.insert(-1, "Edward");
+    cursor.insert(31, "Anne");
+    cursor.insert(23, "Elizabeth");
+    cursor.insert(1, "William");
+    cursor.insert(26, "Charles");
+
+    Dictionary reference;
+    insertTestData(reference);
+    BOOST_CHECK_EQUAL(dict.size(), reference.size());
+    reference.forEach([&](int k, const std::string& item) { isPresent(dict, k, item); });
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+// Mostly ascending keys with local disorder, interleaved with removals and
+// writes through the dictionary itself, checked against a reference.
+BOOST_AUTO_TEST_CASE(NearlySortedWithInterleavedWrites)
+{
+    Dictionary dict;
+    dict.enableMembershipFilter(100, 0.01);
+    dict.enableHashIndex();
+    Dictionary::InsertCursor cursor(dict);
+    std::map<int, std::string> reference;
+    std::mt19937 rng(42);
+    for (int i = 0; i < 5000; ++i) {
+        int k = i + static_cast<int>(rng() % 17) - 8;
+        std::string item = std::to_string(rng() % 100);
+        cursor.insert(k, item);
+        reference[k] = item;
+        if (i % 97 == 0) {
+            int victim = k - static_cast<int>(rng() % 50);
+            dict.remove(victim); // Unlinks nodes the cursor may hold
+            reference.erase(victim);
+        }
+        if (i % 101 == 0) {
+            dict.insert(-i, "direct");
+            reference[-i] = "direct";
+        }
+    }
+
+    BOOST_CHECK_EQUAL(dict.size(), reference.size());
+    for (const auto& entry : reference) {
+        isPresent(dict, entry.first, entry.second);
+    }
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+BOOST_AUTO_TEST_CASE(CursorRespectsCapacity)
+{
+    Dictionary dict;
+    dict.setCapacity(10);
+    Dictionary::InsertCursor cursor(dict);
+    for (int k = 0; k < 100; ++k) {
+        cursor.insert(k, "item"); // Each insert past ten evicts the oldest
+    }
+
+    BOOST_CHECK_EQUAL(dict.size(), 10u);
+    isAbsent(dict, 89);
+    isPresent(dict, 90, "item");
+    isPresent(dict, 99, "item");
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+BOOST_AUTO_TEST_CASE(CursorSurvivesAssignment)
+{
+    Dictionary dict;
+    Dictionary::InsertCursor cursor(dict);
+    for (int k = 0; k < 10; ++k) {
+        cursor.insert(k, "old");
+    }
+    Dictionary other;
+    insertTestData(other);
+    dict = other; // Replaces every node the cursor saw
+    cursor.insert(5, "new");
+
+    isPresent(dict, 5, "new");
+    isPresent(dict, 22, "Mary");
+    isAbsent(dict, 3);
+    BOOST_CHECK_EQUAL(dict.size(), 14u);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Compaction_Tests)
+
+// Ascending inserts build a vine; compaction must leave a tree of minimal
+// height with the nodes laid out in key order at a fixed stride.
+BOOST_AUTO_TEST_CASE(CompactBalancesAndLaysOutInOrder)
+{
+    Dictionary dict;
+    dict.enableLookupCache(64);
+    dict.enableMembershipFilter(100, 0.01);
+    dict.enableHashIndex();
+    for (int k = 0; k < 1000; ++k) {
+        dict.insert(k, std::to_string(k));
+    }
+    isPresent(dict, 500, "500"); // Warm a cache slot
+    BOOST_CHECK_EQUAL(dict.height(), 1000u);
+
+    dict.compact();
+    BOOST_CHECK_EQUAL(dict.height(), 10u);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+
+    std::vector<const char*> items;
+    for (int k = 0; k < 1000; ++k) {
+        isPresent(dict, k, std::to_string(k));
+        items.push_back(reinterpret_cast<const char*>(dict.lookup(k)));
+    }
+    std::ptrdiff_t stride = items[1] - items[0];
+    BOOST_CHECK_GT(stride, 0);
+    for (std::size_t i = 1; i < items.size(); ++i) {
+        BOOST_CHECK_EQUAL(items[i] - items[i - 1], stride);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CompactSmallTrees)
+{
+    Dictionary dict;
+    dict.compact();
+    BOOST_CHECK_EQUAL(dict.size(), 0u);
+
+    insertTestData(dict);
+    dict.compact();
+    dict.compact(); // Moves everything again and releases the first block
+    BOOST_CHECK_EQUAL(dict.height(), 4u);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+    isPresent(dict, 22, "Mary");
+    isPresent(dict, 26, "Charles");
+}
+
+// Slices run between writes, which restart the compaction; the tree must
+// stay correct throughout and end balanced once left alone.
+BOOST_AUTO_TEST_CASE(IncrementalCompactionWithWrites)
+{
+    Dictionary dict;
+    dict.enableHashIndex();
+    std::map<int, std::string> reference;
+    std::mt19937 rng(44);
+    std::vector<int> keys(20000);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), rng); // Recursive insert needs a shallow tree
+    for (int k : keys) {
+        dict.insert(k, "item");
+        reference[k] = "item";
+    }
+
+    for (int round = 0; round < 200; ++round) {
+        dict.compactFor(std::chrono::microseconds(20));
+        if (round % 3 == 0) {
+            int k = static_cast<int>(rng() % 30000);
+            dict.insert(k, "new");
+            reference[k] = "new";
+        }
+        if (round % 5 == 0) {
+            int k = static_cast<int>(rng() % 20000);
+            dict.remove(k);
+            reference.erase(k);
+        }
+        BOOST_REQUIRE_EQUAL(dict.checkInvariants(), "");
+    }
+
+    std::size_t slices = 1;
+    while (!dict.compactFor(std::chrono::microseconds(50))) {
+        ++slices;
+    }
+    BOOST_CHECK_GT(slices, 1u);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+    std::size_t minimal = 0;
+    while ((std::size_t(1) << minimal) - 1 < reference.size()) {
+        ++minimal;
+    }
+    BOOST_CHECK_EQUAL(dict.height(), minimal);
+    BOOST_CHECK_EQUAL(dict.size(), reference.size());
+    for (const auto& entry : reference) {
+        isPresent(dict, entry.first, entry.second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CompactKeepsRecencyAndExpiry)
+{
+    Dictionary dict;
+    dict.setCapacity(101);
+    for (int k = 0; k < 100; ++k) {
+        dict.insert(k, "item");
+    }
+    dict.insert(1000, "short", std::chrono::milliseconds(20));
+    dict.lookup(0); // Key 1 is now the least recently used
+    dict.compact();
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+
+    dict.insert(100, "item");
+    isAbsent(dict, 1);
+    isPresent(dict, 0, "item");
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    isAbsent(dict, 1000);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+// Compacted nodes are freed into their block, which must follow the tree
+// through copies and moves.
+BOOST_AUTO_TEST_CASE(CompactedTreeCopiesAndMoves)
+{
+    Dictionary dict;
+    for (int k = 0; k < 500; ++k) {
+        dict.insert(k, std::to_string(k));
+    }
+    dict.compact();
+
+    Dictionary copy(dict);
+    Dictionary moved(std::move(dict));
+    for (int k = 0; k < 500; k += 2) {
+        moved.remove(k);
+    }
+    Dictionary target;
+    target.insert(1, "replaced");
+    target.compact();
+    target = std::move(moved);
+    target.removeIf([](int k) { return k % 3 == 0; });
+    copy = target;
+
+    BOOST_CHECK_EQUAL(target.checkInvariants(), "");
+    BOOST_CHECK_EQUAL(copy.checkInvariants(), "");
+    isPresent(copy, 1, "1");
+    isAbsent(copy, 3);
+    isPresent(target, 499, "499");
+    BOOST_CHECK_EQUAL(dict.size(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Item_Index_Tests)
+
+BOOST_AUTO_TEST_CASE(KeysForMatchesTraversal)
+{
+    Dictionary dict;
+    insertTestData(dict);
+    dict.enableItemIndex();
+    insertTestData(dict); // Overwrites with the same items
+
+    BOOST_CHECK(dict.keysFor("Elizabeth") == std::vector<int>({ 23, 42 }));
+    BOOST_CHECK(dict.keysFor("Edward") == std::vector<int>({ -1, 9 }));
+    BOOST_CHECK(dict.keysFor("Jane").empty()); // Overwritten by Mary
+    BOOST_CHECK(dict.keysFor("Oliver").empty());
+    BOOST_CHECK(dict.keysFor("Charles") == std::vector<int>({ 26 }));
+    BOOST_CHECK_EQUAL(dict.itemIndexStats().items, 11u);
+
+    Dictionary plain;
+    insertTestData(plain);
+    for (const char* item : { "Elizabeth", "Edward", "Mary", "Stephen", "Nobody" }) {
+        BOOST_CHECK(plain.keysFor(item) == dict.keysFor(item));
+    }
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+BOOST_AUTO_TEST_CASE(OverwriteMovesKeyBetweenItems)
+{
+    Dictionary dict;
+    dict.enableItemIndex();
+    dict.insert(1, "Anne");
+    dict.insert(2, "Anne");
+    dict.insert(1, "Henry");
+    BOOST_CHECK(dict.keysFor("Anne") == std::vector<int>({ 2 }));
+    BOOST_CHECK(dict.keysFor("Henry") == std::vector<int>({ 1 }));
+
+    dict.insert(2, "Henry");
+    BOOST_CHECK(dict.keysFor("Anne").empty());
+    BOOST_CHECK(dict.keysFor("Henry") == std::vector<int>({ 1, 2 }));
+    BOOST_CHECK_EQUAL(dict.itemIndexStats().items, 1u);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+BOOST_AUTO_TEST_CASE(IndexFollowsRemovalsCopiesAndMoves)
+{
+    Dictionary dict;
+    dict.enableItemIndex();
+    insertTestData(dict);
+    dict.remove(42);
+    dict.removeIf([](int key) { return key < 5; });
+    BOOST_CHECK(dict.keysFor("Elizabeth") == std::vector<int>({ 23 }));
+    BOOST_CHECK(dict.keysFor("Edward") == std::vector<int>({ 9 }));
+    BOOST_CHECK(dict.keysFor("Harold").empty());
+
+    Dictionary copy(dict);
+    copy.insert(23, "Anne");
+    BOOST_CHECK(dict.keysFor("Elizabeth") == std::vector<int>({ 23 }));
+    BOOST_CHECK(copy.keysFor("Anne") == std::vector<int>({ 23, 31 }));
+
+    Dictionary moved(std::move(copy));
+    BOOST_CHECK(moved.keysFor("Anne") == std::vector<int>({ 23, 31 }));
+    BOOST_CHECK(copy.keysFor("Anne").empty());
+    BOOST_CHECK_EQUAL(copy.checkInvariants(), "");
+
+    Dictionary target;
+    target = moved;
+    target.removeIfParallel([](int, const std::string& item) { return item == "Anne"; }, 2);
+    BOOST_CHECK(target.keysFor("Anne").empty());
+    moved = std::move(target);
+    BOOST_CHECK(moved.keysFor("Anne").empty());
+    BOOST_CHECK(moved.keysFor("Victoria") == std::vector<int>({ 37 }));
+
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+    BOOST_CHECK_EQUAL(moved.checkInvariants(), "");
+    BOOST_CHECK_EQUAL(target.checkInvariants(), "");
+}
+
+BOOST_AUTO_TEST_CASE(IndexFollowsEvictions)
+{
+    Dictionary dict;
+    dict.enableItemIndex();
+    dict.setCapacity(3);
+    for (int k = 0; k < 10; ++k) {
+        dict.insert(k, k % 2 == 0 ? "even" : "odd");
+    }
+    BOOST_CHECK(dict.keysFor("even") == std::vector<int>({ 8 }));
+    BOOST_CHECK(dict.keysFor("odd") == std::vector<int>({ 7, 9 }));
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+// One item on many keys, including negatives, so groups turn into bitmaps
+// and stay ordered across the sign boundary.
+BOOST_AUTO_TEST_CASE(DenseKeySetsStayOrdered)
+{
+    Dictionary dict;
+    dict.enableItemIndex();
+    std::vector<int> keys;
+    for (int k = -10000; k < 10000; ++k) {
+        keys.push_back(k);
+    }
+    keys.push_back(INT_MIN);
+    keys.push_back(INT_MAX);
+    std::vector<int> shuffled(keys);
+    std::mt19937 rng(45);
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+    for (int k : shuffled) {
+        dict.insert(k, "shared");
+    }
+    std::sort(keys.begin(), keys.end());
+    BOOST_CHECK(dict.keysFor("shared") == keys);
+    BOOST_CHECK_LT(dict.itemIndexStats().memoryBytes, keys.size() * sizeof(int));
+
+    dict.removeIf([](int key) { return key % 3 == 0; });
+    keys.erase(std::remove_if(keys.begin(), keys.end(), [](int key) { return key % 3 == 0; }), keys.end());
+    BOOST_CHECK(dict.keysFor("shared") == keys);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+
+    dict.disableItemIndex();
+    BOOST_CHECK(dict.keysFor("shared") == keys);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
+
+BOOST_AUTO_TEST_SUITE(Merkle_Tests)
+
+// Expected diff between two key-to-item maps.
+std::vector<int> changedKeys(const std::map<int, std::string>& a, const std::map<int, std::string>& b)
+{
+    std::vector<int> keys;
+    for (const auto& entry : a) {
+        auto match = b.find(entry.first);
+        if (match == b.end() || match->second != entry.second) {
+            keys.push_back(entry.first);
+        }
+    }
+    for (const auto& entry : b) {
+        if (a.count(entry.first) == 0) {
+            keys.push_back(entry.first);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+BOOST_AUTO_TEST_CASE(HashIgnoresShape)
+{
+    Dictionary forward;
+    Dictionary backward;
+    for (int k = 0; k < 200; ++k) {
+        forward.insert(k, std::to_string(k));
+        backward.insert(199 - k, std::to_string(199 - k));
+    }
+    BOOST_CHECK(forward.contentEquals(backward));
+    BOOST_CHECK_EQUAL(forward.contentHash(), backward.contentHash());
+    BOOST_CHECK(forward.diff(backward).empty());
+
+    backward.insert(50, "changed");
+    BOOST_CHECK(!forward.contentEquals(backward));
+    BOOST_CHECK(forward.diff(backward) == std::vector<int>({ 50 }));
+    backward.insert(50, "50");
+    BOOST_CHECK(forward.contentEquals(backward));
+
+    Dictionary empty;
+    BOOST_CHECK(Dictionary().contentEquals(empty));
+    BOOST_CHECK_EQUAL(empty.contentHash(), 0u);
+    BOOST_CHECK_EQUAL(forward.diff(empty).size(), 200u);
+}
+
+// A copy keeps the shape, so diff follows both trees in lockstep; a tree
+// built in another order, or a vine, takes the general path.
+BOOST_AUTO_TEST_CASE(DiffFindsChangedKeys)
+{
+    std::mt19937 rng(46);
+    std::vector<int> keys(5000);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    Dictionary original;
+    std::map<int, std::string> before;
+    for (int k : keys) {
+        original.insert(k, "item" + std::to_string(k % 7));
+        before[k] = "item" + std::to_string(k % 7);
+    }
+
+    Dictionary copy(original);
+    std::map<int, std::string> after(before);
+    for (int i = 0; i < 60; ++i) {
+        int k = static_cast<int>(rng() % 6000);
+        switch (i % 3) {
+        case 0: copy.remove(k); after.erase(k); break;
+        case 1: copy.insert(k, "new"); after[k] = "new"; break;
+        default: copy.insert(k, "item" + std::to_string(k % 7)); after[k] = "item" + std::to_string(k % 7); break;
+        }
+    }
+    std::vector<int> expected = changedKeys(before, after);
+    BOOST_CHECK(!expected.empty());
+    BOOST_CHECK(original.diff(copy) == expected);
+    BOOST_CHECK(copy.diff(original) == expected);
+
+    Dictionary reshuffled;
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (int k : keys) {
+        auto entry = after.find(k);
+        if (entry != after.end()) {
+            reshuffled.insert(k, entry->second);
+        }
+    }
+    for (const auto& entry : after) {
+        reshuffled.insert(entry.first, entry.second);
+    }
+    BOOST_CHECK(reshuffled.contentEquals(copy));
+    BOOST_CHECK(original.diff(reshuffled) == expected);
+
+    Dictionary vine;
+    Dictionary::InsertCursor cursor(vine);
+    for (const auto& entry : after) {
+        cursor.insert(entry.first, entry.second); // Ascending: one long right spine
+    }
+    BOOST_CHECK_EQUAL(vine.height(), after.size());
+    BOOST_CHECK(original.diff(vine) == expected);
+    BOOST_CHECK(vine.diff(original) == expected);
+}
+
+// Every path that relinks nodes must keep the subtree sums, which
+// checkInvariants verifies node by node.
+BOOST_AUTO_TEST_CASE(HashesSurviveRestructuring)
+{
+    Dictionary dict;
+    insertTestData(dict);
+    Dictionary reference;
+    insertTestData(reference);
+
+    dict.compact(); // Rotations throughout, then relocation
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+    BOOST_CHECK(dict.contentEquals(reference));
+
+    std::vector<Dictionary::BatchWrite> writes = { { -1, true, "" }, { 5, false, "Anne" }, { 22, false, "Jane" }, { 37, true, "" } };
+    dict.applyBatch(writes);
+    reference.applyBatch(writes);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+    BOOST_CHECK(dict.contentEquals(reference));
+
+    dict.removeIfParallel([](int key, const std::string&) { return key % 2 == 0; }, 2);
+    reference.removeIf([](int key) { return key % 2 == 0; });
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+    BOOST_CHECK(dict.contentEquals(reference));
+
+    Dictionary::InsertCursor cursor(dict);
+    for (int k = 100; k < 120; ++k) {
+        cursor.insert(k, "cursor");
+        reference.insert(k, "cursor");
+    }
+    dict.setCapacity(10);
+    reference.setCapacity(10);
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+    BOOST_CHECK(dict.diff(reference).empty());
+}
+
+// Writes through the pointer from lookup are outside the hashes by
+// contract; checkInvariants is what exposes them. insert keeps them in step.
+BOOST_AUTO_TEST_CASE(LookupWritesBypassHashes)
+{
+    Dictionary dict;
+    insertTestData(dict);
+    Dictionary reference;
+    insertTestData(reference);
+
+    dict.insert(22, "Maria");
+    BOOST_CHECK(!dict.contentEquals(reference));
+    BOOST_CHECK(dict.diff(reference) == std::vector<int>{ 22 });
+    dict.insert(22, "Mary");
+    BOOST_CHECK(dict.contentEquals(reference));
+
+    *dict.lookup(22) = "Maria";
+    BOOST_CHECK_EQUAL(dict.contentHash(), reference.contentHash()); // Not seen
+    BOOST_CHECK(dict.diff(reference).empty());
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "subtree hash is stale at key 22");
+
+    *dict.lookup(22) = "Mary";
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+}
+
+// Cursor writes leave the sums above them pending; every other operation
+// must see the same sums as if each write had been applied at once. Two
+// cursors take turns, and plain writes land on keys along their paths.
+BOOST_AUTO_TEST_CASE(DeferredHashesAcrossCursors)
+{
+    Dictionary dict;
+    Dictionary reference;
+    std::mt19937 rng(46);
+    {
+        Dictionary::InsertCursor low(dict);
+        Dictionary::InsertCursor high(dict);
+        for (int k = 0; k < 400; ++k) {
+            std::string item = std::to_string(rng() % 7);
+            if (k % 2 == 0) {
+                low.insert(k, item);
+            }
+            else {
+                high.insert(100000 + k, item);
+            }
+            reference.insert(k % 2 == 0 ? k : 100000 + k, item);
+
+            switch (rng() % 8) {
+            case 0: // Overwrite a key the last cursor write passed through
+                dict.insert(k / 2, "plain");
+                reference.insert(k / 2, "plain");
+                break;
+            case 1:
+                dict.remove(k - 3);
+                reference.remove(k - 3);
+                break;
+            case 2:
+                BOOST_REQUIRE_EQUAL(dict.checkInvariants(), "");
+                break;
+            case 3:
+                BOOST_REQUIRE(dict.contentEquals(reference));
+                break;
+            default:
+                break;
+            }
+        }
+        BOOST_CHECK(dict.diff(reference).empty());
+        BOOST_CHECK_EQUAL(dict.contentHash(), reference.contentHash());
+        low.insert(-1, "last");
+        reference.insert(-1, "last");
+    }
+    BOOST_CHECK_EQUAL(dict.checkInvariants(), "");
+    BOOST_CHECK(dict.contentEquals(reference));
+
+    Dictionary copy(dict); // Copies see the applied sums
+    Dictionary::InsertCursor cursor(copy);
+    cursor.insert(500000, "x");
+    Dictionary moved(std::move(copy));
+    reference.insert(500000, "x");
+    BOOST_CHECK_EQUAL(moved.checkInvariants(), "");
+    BOOST_CHECK(moved.contentEquals(reference));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+////////////////////////////////////////////////////////////////////////////////
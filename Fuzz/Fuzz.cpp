@@ -0,0 +1,572 @@
+#include "Dictionary.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Differential fuzzing of Dictionary against a std::map oracle. Each input
+// is read as a sequence of operations (insert, lookup, remove, both removeIf
+// forms, the parallel removeIf, copy and move in both forms, inserts through
+// a long-lived cursor, batched writes, inserts with a TTL, capacity limits,
+// full and sliced compaction, reverse lookups by item, diffs against an
+// earlier snapshot, and toggling the lookup cache, membership filter, hash
+// index and item index). In bounded mode the oracle keeps its own recency
+// order and evicts as the dictionary should; TTLs are either zero, expiring
+// at once, or an hour, never reached, so runs replay exactly. After every
+// step the dictionary's own invariants are checked and its size compared
+// with the oracle's; the full contents are compared periodically and at the
+// end. Any mismatch prints the step and aborts.
+//
+// Built with -DDICTIONARY_LIBFUZZER -fsanitize=fuzzer this is a libFuzzer
+// target. Otherwise it is a standalone driver:
+//
+//     Fuzz [seed] [inputs]   random inputs, then an unchecked throughput pass
+//     Fuzz --replay file     run one saved input, e.g. a libFuzzer crash
+//
+// Both run under ASan/UBSan (-fsanitize=address,undefined) and TSan
+// (-fsanitize=thread), which checks the parallel removeIf.
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Input Decoding
+
+// Reads fixed-size fields from the input, yielding zeros once it runs out.
+class FuzzInput {
+public:
+    FuzzInput(const std::uint8_t* data, std::size_t size) : data(data), size(size), offset(0) {}
+
+    bool empty() const { return offset >= size; }
+
+    std::uint8_t byte()
+    {
+        return offset < size ? data[offset++] : 0;
+    }
+
+    // Keys come from a small range so that operations keep colliding.
+    int key()
+    {
+        int high = byte();
+        int low = byte();
+        return ((high << 8 | low) % 2048) - 1024;
+    }
+
+    std::string item()
+    {
+        static const char* const names[] = {
+            "Jane", "Mary", "Harold", "Edward", "Victoria", "Matilda", "Oliver", "Elizabeth",
+        };
+        std::uint8_t choice = byte();
+        std::string item = names[choice % 8];
+        if (choice & 0x80) {
+            item += std::string(choice & 0x3F, '+'); // Longer items exercise the byte count
+        }
+        return item;
+    }
+
+private:
+    const std::uint8_t* data;
+    std::size_t size;
+    std::size_t offset;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Differential Run
+
+enum class Op : std::uint8_t {
+    Insert,
+    Lookup,
+    Remove,
+    RemoveIfKey,
+    RemoveIfItem,
+    RemoveIfParallel,
+    CopyConstruct,
+    CopyAssign,
+    MoveConstruct,
+    MoveAssign,
+    ToggleCache,
+    ToggleFilter,
+    ToggleHashIndex,
+    CursorInsert,
+    Compact,
+    ToggleItemIndex,
+    KeysFor,
+    Diff,
+    SetCapacity,
+    InsertTtl,
+    ApplyBatch,
+    Count
+};
+
+class DifferentialRun {
+public:
+    explicit DifferentialRun(bool checked)
+        : checked(checked), steps(0), cursor(dict), cursorKey(0), maxEntries(0), maxBytes(0), useClock(0),
+          cacheOn(false), filterOn(false), indexOn(false), itemIndexOn(false), rebalanced(false) {}
+
+    std::size_t operations() const { return steps; }
+
+    void run(const std::uint8_t* data, std::size_t size)
+    {
+        FuzzInput input(data, size);
+        while (!input.empty()) {
+            // Plain writes and lookups dominate; the rest are rarer.
+            std::uint8_t selector = input.byte();
+            Op op = selector < 160 ? static_cast<Op>(selector % 3) : static_cast<Op>(selector % static_cast<int>(Op::Count));
+            rebalanced = false;
+            apply(op, input);
+            ++steps;
+            if (checked) {
+                check(steps % 64 == 0);
+            }
+        }
+        if (checked) {
+            check(true);
+        }
+    }
+
+private:
+    bool checked;
+    std::size_t steps;
+    Dictionary dict;
+    std::map<int, std::string> oracle;
+    Dictionary snapshot; // Earlier contents, for diff
+    std::map<int, std::string> snapshotOracle;
+    Dictionary::InsertCursor cursor; // Outlives every reshaping of 'dict'
+    int cursorKey;
+    std::size_t maxEntries; // The dictionary's limits, mirrored
+    std::size_t maxBytes;
+    std::map<int, std::uint64_t> lastUse; // Oracle recency; stale for erased keys
+    std::uint64_t useClock;
+    bool cacheOn;
+    bool filterOn;
+    bool indexOn;
+    bool itemIndexOn;
+    bool rebalanced; // The last step relinked the tree
+
+    void apply(Op op, FuzzInput& input)
+    {
+        switch (op) {
+        case Op::Insert: {
+            int key = input.key();
+            std::string item = input.item();
+            dict.insert(key, item);
+            write(key, item);
+            break;
+        }
+        case Op::Lookup: {
+            int key = input.key();
+            std::string* item = dict.lookup(key);
+            auto expected = oracle.find(key);
+            if (checked && (item == nullptr) != (expected == oracle.end())) {
+                fail("lookup(" + std::to_string(key) + ") disagrees on presence");
+            }
+            if (checked && item != nullptr && *item != expected->second) {
+                fail("lookup(" + std::to_string(key) + ") returned " + *item + " instead of " + expected->second);
+            }
+            if (expected != oracle.end()) {
+                lastUse[key] = ++useClock;
+            }
+            break;
+        }
+        case Op::Remove: {
+            int key = input.key();
+            dict.remove(key);
+            oracle.erase(key);
+            break;
+        }
+        case Op::RemoveIfKey: {
+            int modulus = 2 + input.byte() % 15;
+            int residue = input.byte() % modulus;
+            auto predicate = [=](int key) { return ((key % modulus) + modulus) % modulus == residue; };
+            dict.removeIf(predicate);
+            eraseFromOracle([&](int key, const std::string&) { return predicate(key); });
+            break;
+        }
+        case Op::RemoveIfItem: {
+            std::string target = input.item();
+            auto predicate = [=](int, const std::string& item) { return item == target; };
+            dict.removeIf(predicate);
+            eraseFromOracle(predicate);
+            break;
+        }
+        case Op::RemoveIfParallel: {
+            unsigned threads = 1 + input.byte() % 4;
+            char initial = static_cast<char>('A' + input.byte() % 26);
+            auto predicate = [=](int, const std::string& item) { return item[0] == initial; };
+            std::size_t before = oracle.size();
+            dict.removeIfParallel(predicate, threads);
+            eraseFromOracle(predicate);
+            rebalanced = oracle.size() != before;
+            break;
+        }
+        case Op::CopyConstruct: {
+            Dictionary copy(dict);
+            dict = std::move(copy);
+            break;
+        }
+        case Op::CopyAssign: {
+            Dictionary copy;
+            copy.insert(input.key(), input.item()); // Assignment must replace this
+            copy = dict;
+            if (checked && copy.size() != dict.size()) {
+                fail("copy assignment changed the size");
+            }
+            dict = copy;
+            break;
+        }
+        case Op::MoveConstruct: {
+            Dictionary moved(std::move(dict));
+            if (checked && dict.size() != 0) {
+                fail("moved-from dictionary is not empty");
+            }
+            dict = std::move(moved);
+            break;
+        }
+        case Op::MoveAssign: {
+            Dictionary target;
+            target.insert(input.key(), input.item());
+            target = std::move(dict);
+            dict = std::move(target);
+            break;
+        }
+        case Op::ToggleCache:
+            cacheOn = !cacheOn;
+            if (cacheOn) {
+                dict.enableLookupCache(1 + input.byte());
+            }
+            else {
+                dict.disableLookupCache();
+            }
+            break;
+        case Op::ToggleFilter:
+            filterOn = !filterOn;
+            if (filterOn) {
+                dict.enableMembershipFilter(1 + input.byte(), 0.01); // Small, so it regrows
+            }
+            else {
+                dict.disableMembershipFilter();
+            }
+            break;
+        case Op::ToggleHashIndex:
+            indexOn = !indexOn;
+            if (indexOn) {
+                dict.enableHashIndex();
+            }
+            else {
+                dict.disableHashIndex();
+            }
+            break;
+        case Op::CursorInsert: {
+            // Mostly near the previous cursor key, as in nearly-sorted ingest.
+            std::uint8_t step = input.byte();
+            cursorKey = step < 32 ? input.key() : cursorKey + step % 16 - 4;
+            std::string item = input.item();
+            cursor.insert(cursorKey, item);
+            write(cursorKey, item);
+            break;
+        }
+        case Op::Compact:
+            // A zero budget stops after the first 64 steps, so sliced runs
+            // replay deterministically and pause mid-way on larger trees.
+            if (input.byte() % 4 == 0) {
+                dict.compact();
+                rebalanced = true;
+            }
+            else {
+                rebalanced = dict.compactFor(Dictionary::Clock::duration::zero());
+            }
+            break;
+        case Op::ToggleItemIndex:
+            itemIndexOn = !itemIndexOn;
+            if (itemIndexOn) {
+                dict.enableItemIndex();
+            }
+            else {
+                dict.disableItemIndex();
+            }
+            break;
+        case Op::KeysFor: {
+            std::string item = input.item();
+            std::vector<int> keys = dict.keysFor(item);
+            if (checked) {
+                std::vector<int> expected;
+                for (const auto& entry : oracle) {
+                    if (entry.second == item) {
+                        expected.push_back(entry.first);
+                    }
+                }
+                if (keys != expected) {
+                    fail("keysFor(" + item + ") returned " + std::to_string(keys.size()) + " keys, expected " + std::to_string(expected.size()));
+                }
+            }
+            break;
+        }
+        case Op::Diff: {
+            std::vector<int> changed = dict.diff(snapshot);
+            if (checked) {
+                std::vector<int> expected;
+                auto mine = oracle.begin();
+                auto theirs = snapshotOracle.begin();
+                while (mine != oracle.end() || theirs != snapshotOracle.end()) {
+                    if (theirs == snapshotOracle.end() || (mine != oracle.end() && mine->first < theirs->first)) {
+                        expected.push_back((mine++)->first);
+                    }
+                    else if (mine == oracle.end() || theirs->first < mine->first) {
+                        expected.push_back((theirs++)->first);
+                    }
+                    else {
+                        if (mine->second != theirs->second) {
+                            expected.push_back(mine->first);
+                        }
+                        ++mine;
+                        ++theirs;
+                    }
+                }
+                if (changed != expected) {
+                    fail("diff found " + std::to_string(changed.size()) + " changed keys, expected " + std::to_string(expected.size()));
+                }
+                if (dict.contentEquals(snapshot) != expected.empty()) {
+                    fail("contentEquals disagrees with diff");
+                }
+            }
+            // Take the next snapshot as a copy, which shares the shape, or
+            // rebuilt in key order as one long spine.
+            if (input.byte() % 2 == 0) {
+                snapshot = dict;
+            }
+            else {
+                snapshot = Dictionary();
+                Dictionary::InsertCursor ascending(snapshot);
+                for (const auto& entry : oracle) {
+                    ascending.insert(entry.first, entry.second);
+                }
+            }
+            snapshotOracle = oracle;
+            break;
+        }
+        case Op::SetCapacity: {
+            // Limits small enough to evict, or none; bytes in whole entries.
+            std::uint8_t choice = input.byte();
+            std::size_t entries = choice % 4 == 0 ? 0 : 1 + input.byte() % 64;
+            std::size_t bytes = choice % 3 == 0 ? (1 + input.byte() % 64) * (entryOverhead() + 8) : 0;
+            bool wasBounded = bounded();
+            dict.setCapacity(entries, bytes);
+            maxEntries = entries;
+            maxBytes = bytes;
+            if (!wasBounded && bounded()) {
+                for (const auto& entry : oracle) {
+                    lastUse[entry.first] = ++useClock; // Threaded in key order
+                }
+            }
+            if (bounded()) {
+                enforceBounds(nullptr);
+            }
+            break;
+        }
+        case Op::InsertTtl: {
+            int key = input.key();
+            std::string item = input.item();
+            if (input.byte() % 2 == 0) {
+                // Expired before the call returns, so nothing is kept from
+                // the eviction that follows.
+                dict.insert(key, item, Dictionary::Clock::duration::zero());
+                oracle.erase(key);
+                if (bounded()) {
+                    enforceBounds(nullptr);
+                }
+            }
+            else {
+                dict.insert(key, item, std::chrono::hours(1));
+                write(key, item);
+            }
+            break;
+        }
+        case Op::ApplyBatch: {
+            std::vector<Dictionary::BatchWrite> writes(input.byte() % 16);
+            int key = input.key();
+            for (Dictionary::BatchWrite& entry : writes) {
+                entry.key = key;
+                entry.erase = input.byte() % 4 == 0;
+                entry.item = entry.erase ? "" : input.item();
+                key += 1 + input.byte() % 8; // Strictly ascending
+            }
+            dict.applyBatch(writes);
+            for (const Dictionary::BatchWrite& entry : writes) {
+                if (entry.erase) {
+                    oracle.erase(entry.key);
+                }
+                else {
+                    write(entry.key, entry.item);
+                }
+            }
+            break;
+        }
+        case Op::Count:
+            break;
+        }
+    }
+
+    bool bounded() const
+    {
+        return maxEntries != 0 || maxBytes != 0;
+    }
+
+    // Bytes the dictionary charges per entry on top of its item's length.
+    static std::size_t entryOverhead()
+    {
+        static const std::size_t overhead = [] {
+            Dictionary probe;
+            probe.insert(0, "");
+            return probe.evictionStats().bytes;
+        }();
+        return overhead;
+    }
+
+    // An insert as the oracle sees it: the entry becomes the most recent,
+    // and in bounded mode the least recent others are evicted.
+    void write(int key, const std::string& item)
+    {
+        oracle[key] = item;
+        lastUse[key] = ++useClock;
+        if (bounded()) {
+            enforceBounds(&key);
+        }
+    }
+
+    // Evict from the least recent end while over a limit, stopping at 'keep'.
+    void enforceBounds(const int* keep)
+    {
+        std::vector<std::pair<std::uint64_t, int>> byUse;
+        std::size_t bytes = 0;
+        for (const auto& entry : oracle) {
+            byUse.emplace_back(lastUse[entry.first], entry.first);
+            bytes += entryOverhead() + entry.second.size();
+        }
+        std::sort(byUse.begin(), byUse.end());
+        for (const auto& coldest : byUse) {
+            bool over = (maxEntries != 0 && oracle.size() > maxEntries) || (maxBytes != 0 && bytes > maxBytes);
+            if (!over || (keep != nullptr && coldest.second == *keep)) {
+                break;
+            }
+            auto evicted = oracle.find(coldest.second);
+            bytes -= entryOverhead() + evicted->second.size();
+            oracle.erase(evicted);
+        }
+    }
+
+    template <typename Predicate>
+    void eraseFromOracle(Predicate predicate)
+    {
+        for (auto entry = oracle.begin(); entry != oracle.end();) {
+            entry = predicate(entry->first, entry->second) ? oracle.erase(entry) : std::next(entry);
+        }
+    }
+
+    void check(bool compareContents)
+    {
+        std::string broken = dict.checkInvariants();
+        if (!broken.empty()) {
+            fail(broken);
+        }
+        if (dict.size() != oracle.size()) {
+            fail("size is " + std::to_string(dict.size()) + ", expected " + std::to_string(oracle.size()));
+        }
+        // When the parallel removeIf removes anything, it relinks the
+        // survivors into a tree of minimal height; so does finished compaction.
+        if (rebalanced) {
+            std::size_t minimal = 0;
+            while ((std::size_t(1) << minimal) - 1 < oracle.size()) {
+                ++minimal;
+            }
+            if (dict.height() != minimal) {
+                fail("height " + std::to_string(dict.height()) + " after rebalancing, expected " + std::to_string(minimal));
+            }
+        }
+        if (compareContents) {
+            auto expected = oracle.begin();
+            dict.forEach([&](int key, const std::string& item) {
+                if (expected == oracle.end() || expected->first != key || expected->second != item) {
+                    fail("contents differ at key " + std::to_string(key));
+                }
+                ++expected;
+            });
+            if (expected != oracle.end()) {
+                fail("key " + std::to_string(expected->first) + " is missing");
+            }
+        }
+    }
+
+    void fail(const std::string& message) const
+    {
+        std::cerr << "Mismatch after " << steps << " operations: " << message << std::endl;
+        std::abort();
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Entry Points
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    DifferentialRun run(true);
+    run.run(data, size);
+    return 0;
+}
+
+#if !defined(DICTIONARY_LIBFUZZER)
+
+int main(int argc, char* argv[])
+{
+    if (argc == 3 && std::strcmp(argv[1], "--replay") == 0) {
+        std::ifstream file(argv[2], std::ios::binary);
+        std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+        std::cout << "Replayed " << data.size() << " bytes without a mismatch" << std::endl;
+        return 0;
+    }
+
+    unsigned seed = argc > 1 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10)) : 39;
+    std::size_t inputs = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200;
+    std::mt19937 rng(seed);
+
+    // Inputs of varying length, so both short and long histories are covered.
+    std::vector<std::vector<std::uint8_t>> corpus(inputs);
+    for (std::vector<std::uint8_t>& data : corpus) {
+        data.resize(64 + rng() % 32768);
+        for (std::uint8_t& byte : data) {
+            byte = static_cast<std::uint8_t>(rng());
+        }
+    }
+
+    // The same inputs are run twice: checked against the oracle, then bare
+    // as a throughput smoke test.
+    const bool modes[] = { true, false };
+    for (bool checked : modes) {
+        std::size_t operations = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const std::vector<std::uint8_t>& data : corpus) {
+            DifferentialRun run(checked);
+            run.run(data.data(), data.size());
+            operations += run.operations();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << (checked ? "checked: " : "unchecked: ") << operations << " operations in " << seconds
+            << " s, " << static_cast<std::size_t>(operations / seconds) << " ops/sec" << std::endl;
+    }
+    std::cout << "Seed " << seed << ": " << inputs << " inputs matched std::map" << std::endl;
+    return 0;
+}
+
+#endif
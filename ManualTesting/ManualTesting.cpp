@@ -1,7 +1,635 @@
 #include "Dictionary.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
-int main()
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Workload record and replay for Dictionary. A trace is a sequence of
+// operations kept in a file, replayed with per-operation latency histograms
+// so that a production slowdown can be reproduced offline.
+//
+//     ManualTesting replay <trace>
+//     ManualTesting generate <trace> [--ops N] [--keys N] [--seed N] [--text]
+//         [--dist uniform|zipf|sequential|nearly-sorted] [--mix I,L,R,F]
+//     ManualTesting             (no arguments: print the sample tree)
+//
+// Text traces hold one operation per line; '#' starts a comment:
+//
+//     insert 22 Jane
+//     lookup 22
+//     remove 22
+//     removeIf keys 10 20        (every key in [10, 20])
+//     removeIf item Elizabeth    (every entry whose item is Elizabeth)
+//
+// Binary traces start with the 8-byte magic "DICTRC1\0", then hold records
+// of a one-byte operation code and a little-endian int32 key, followed for
+// insert and removeIf item by a uint32 length and the item bytes, and for
+// removeIf keys by the int32 upper bound.
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Trace Format
+
+enum class TraceOp : std::uint8_t {
+	Insert,
+	Lookup,
+	Remove,
+	RemoveIfKeys,
+	RemoveIfItem,
+	Count
+};
+
+static const char* const traceOpNames[] = { "insert", "lookup", "remove", "removeIf keys", "removeIf item" };
+
+static const char binaryMagic[8] = { 'D', 'I', 'C', 'T', 'R', 'C', '1', '\0' };
+
+// One decoded operation. The item points into the mapped trace.
+struct TraceRecord {
+	TraceOp op;
+	int key;
+	int high; // Upper bound for removeIf keys
+	const char* item;
+	std::size_t itemLength;
+};
+
+// Read-only view of a whole file, mapped rather than read so that large
+// traces are paged in as the replay reaches them.
+class MappedFile {
+public:
+	// A failure releases whatever was already opened before throwing, since
+	// the destructor does not run for a constructor that threw.
+	explicit MappedFile(const std::string& path)
+		: bytes(nullptr), length(0)
+	{
+#if defined(_WIN32)
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		mapping = nullptr;
+		LARGE_INTEGER size;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+			release();
+			throw std::runtime_error("cannot open " + path);
+		}
+		length = static_cast<std::size_t>(size.QuadPart);
+		if (length != 0) {
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			bytes = mapping != nullptr ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+			if (bytes == nullptr) {
+				release();
+				throw std::runtime_error("cannot map " + path);
+			}
+		}
+#else
+		file = open(path.c_str(), O_RDONLY);
+		struct stat status;
+		if (file < 0 || fstat(file, &status) != 0) {
+			release();
+			throw std::runtime_error("cannot open " + path);
+		}
+		length = static_cast<std::size_t>(status.st_size);
+		if (length != 0) {
+			void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+			if (view == MAP_FAILED) {
+				release();
+				throw std::runtime_error("cannot map " + path);
+			}
+			madvise(view, length, MADV_SEQUENTIAL);
+			bytes = static_cast<const char*>(view);
+		}
+#endif
+	}
+
+	~MappedFile()
+	{
+		release();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data() const { return bytes; }
+	std::size_t size() const { return length; }
+
+private:
+	const char* bytes;
+	std::size_t length;
+#if defined(_WIN32)
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+
+	void release()
+	{
+#if defined(_WIN32)
+		if (bytes != nullptr) UnmapViewOfFile(bytes);
+		if (mapping != nullptr) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes != nullptr) munmap(const_cast<char*>(bytes), length);
+		if (file >= 0) close(file);
+		file = -1;
+#endif
+		bytes = nullptr;
+	}
+};
+
+// Decodes one record at a time from either format.
+class TraceReader {
+public:
+	TraceReader(const char* data, std::size_t size)
+		: position(data), end(data + size), binary(false), line(0)
+	{
+		if (size >= sizeof(binaryMagic) && std::memcmp(data, binaryMagic, sizeof(binaryMagic)) == 0) {
+			binary = true;
+			position += sizeof(binaryMagic);
+		}
+	}
+
+	// False at the end of the trace; throws on a malformed record.
+	bool next(TraceRecord& record)
+	{
+		return binary ? nextBinary(record) : nextText(record);
+	}
+
+private:
+	const char* position;
+	const char* end;
+	bool binary;
+	std::size_t line;
+
+	bool nextBinary(TraceRecord& record)
+	{
+		if (position == end) {
+			return false;
+		}
+		std::uint8_t op = static_cast<std::uint8_t>(*position++);
+		if (op >= static_cast<std::uint8_t>(TraceOp::Count)) {
+			throw std::runtime_error("unknown operation code " + std::to_string(op));
+		}
+		record.op = static_cast<TraceOp>(op);
+		record.key = static_cast<int>(readWord());
+		record.high = record.key;
+		record.item = nullptr;
+		record.itemLength = 0;
+		if (record.op == TraceOp::RemoveIfKeys) {
+			record.high = static_cast<int>(readWord());
+		}
+		else if (record.op == TraceOp::Insert || record.op == TraceOp::RemoveIfItem) {
+			record.itemLength = readWord();
+			if (static_cast<std::size_t>(end - position) < record.itemLength) {
+				throw std::runtime_error("truncated item");
+			}
+			record.item = position;
+			position += record.itemLength;
+		}
+		return true;
+	}
+
+	std::uint32_t readWord()
+	{
+		if (end - position < 4) {
+			throw std::runtime_error("truncated record");
+		}
+		const unsigned char* b = reinterpret_cast<const unsigned char*>(position);
+		position += 4;
+		return std::uint32_t(b[0]) | std::uint32_t(b[1]) << 8 | std::uint32_t(b[2]) << 16 | std::uint32_t(b[3]) << 24;
+	}
+
+	bool nextText(TraceRecord& record)
+	{
+		while (position != end) {
+			const char* lineEnd = static_cast<const char*>(std::memchr(position, '\n', end - position));
+			if (lineEnd == nullptr) {
+				lineEnd = end;
+			}
+			const char* cursor = position;
+			position = lineEnd == end ? end : lineEnd + 1;
+			++line;
+
+			const char* stop = lineEnd;
+			if (stop != cursor && stop[-1] == '\r') {
+				--stop;
+			}
+			std::string word = nextWord(cursor, stop);
+			if (word.empty() || word[0] == '#') {
+				continue;
+			}
+
+			record.item = nullptr;
+			record.itemLength = 0;
+			if (word == "insert") {
+				record.op = TraceOp::Insert;
+				record.key = parseKey(nextWord(cursor, stop));
+				restOfLine(cursor, stop, record);
+			}
+			else if (word == "lookup" || word == "remove") {
+				record.op = word == "lookup" ? TraceOp::Lookup : TraceOp::Remove;
+				record.key = parseKey(nextWord(cursor, stop));
+			}
+			else if (word == "removeIf") {
+				std::string form = nextWord(cursor, stop);
+				if (form == "keys") {
+					record.op = TraceOp::RemoveIfKeys;
+					record.key = parseKey(nextWord(cursor, stop));
+					record.high = parseKey(nextWord(cursor, stop));
+					return true;
+				}
+				if (form != "item") {
+					fail("removeIf takes 'keys' or 'item'");
+				}
+				record.op = TraceOp::RemoveIfItem;
+				record.key = 0;
+				restOfLine(cursor, stop, record);
+			}
+			else {
+				fail("unknown operation '" + word + "'");
+			}
+			record.high = record.key;
+			return true;
+		}
+		return false;
+	}
+
+	static std::string nextWord(const char*& cursor, const char* stop)
+	{
+		while (cursor != stop && (*cursor == ' ' || *cursor == '\t')) {
+			++cursor;
+		}
+		const char* start = cursor;
+		while (cursor != stop && *cursor != ' ' && *cursor != '\t') {
+			++cursor;
+		}
+		return std::string(start, cursor);
+	}
+
+	// The item is the rest of the line after one separator, spaces included.
+	static void restOfLine(const char* cursor, const char* stop, TraceRecord& record)
+	{
+		if (cursor != stop) {
+			++cursor;
+		}
+		record.item = cursor;
+		record.itemLength = stop - cursor;
+	}
+
+	int parseKey(const std::string& word) const
+	{
+		char* parsed = nullptr;
+		errno = 0;
+		long value = std::strtol(word.c_str(), &parsed, 10);
+		if (word.empty() || *parsed != '\0') {
+			fail("expected a key, found '" + word + "'");
+		}
+		if (errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+			fail("key " + word + " is out of range");
+		}
+		return static_cast<int>(value);
+	}
+
+	void fail(const std::string& message) const
+	{
+		throw std::runtime_error("line " + std::to_string(line) + ": " + message);
+	}
+};
+
+class TraceWriter {
+public:
+	TraceWriter(const std::string& path, bool text)
+		: out(path, std::ios::binary), text(text)
+	{
+		if (!out) {
+			throw std::runtime_error("cannot create " + path);
+		}
+		if (!text) {
+			out.write(binaryMagic, sizeof(binaryMagic));
+		}
+	}
+
+	void write(TraceOp op, int key, int high, const std::string& item)
+	{
+		if (text) {
+			switch (op) {
+			case TraceOp::Insert: out << "insert " << key << ' ' << item << '\n'; break;
+			case TraceOp::Lookup: out << "lookup " << key << '\n'; break;
+			case TraceOp::Remove: out << "remove " << key << '\n'; break;
+			case TraceOp::RemoveIfKeys: out << "removeIf keys " << key << ' ' << high << '\n'; break;
+			case TraceOp::RemoveIfItem: out << "removeIf item " << item << '\n'; break;
+			case TraceOp::Count: break;
+			}
+			return;
+		}
+		out.put(static_cast<char>(op));
+		writeWord(static_cast<std::uint32_t>(key));
+		if (op == TraceOp::RemoveIfKeys) {
+			writeWord(static_cast<std::uint32_t>(high));
+		}
+		else if (op == TraceOp::Insert || op == TraceOp::RemoveIfItem) {
+			writeWord(static_cast<std::uint32_t>(item.size()));
+			out.write(item.data(), item.size());
+		}
+	}
+
+private:
+	std::ofstream out;
+	bool text;
+
+	void writeWord(std::uint32_t word)
+	{
+		char bytes[4] = { char(word), char(word >> 8), char(word >> 16), char(word >> 24) };
+		out.write(bytes, 4);
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Latency Histogram
+
+// Log-linear buckets: exact below 16 ns, then 16 buckets per power of two,
+// so any recorded value is within 1/16 of its bucket's bounds.
+class LatencyHistogram {
+public:
+	LatencyHistogram() : buckets(16 + 60 * 16, 0), count(0), total(0), largest(0) {}
+
+	void record(std::uint64_t nanoseconds)
+	{
+		++buckets[bucketFor(nanoseconds)];
+		++count;
+		total += nanoseconds;
+		largest = std::max(largest, nanoseconds);
+	}
+
+	std::uint64_t samples() const { return count; }
+	double mean() const { return count != 0 ? static_cast<double>(total) / count : 0.0; }
+	std::uint64_t max() const { return largest; }
+
+	// Upper bound of the bucket holding the q-th quantile.
+	std::uint64_t percentile(double q) const
+	{
+		std::uint64_t rank = static_cast<std::uint64_t>(std::ceil(q * count));
+		std::uint64_t seen = 0;
+		for (std::size_t i = 0; i < buckets.size(); ++i) {
+			seen += buckets[i];
+			if (seen >= rank && seen != 0) {
+				return std::min(upperBound(i), largest);
+			}
+		}
+		return largest;
+	}
+
+private:
+	std::vector<std::uint64_t> buckets;
+	std::uint64_t count;
+	std::uint64_t total;
+	std::uint64_t largest;
+
+	static std::size_t bucketFor(std::uint64_t value)
+	{
+		if (value < 16) {
+			return static_cast<std::size_t>(value);
+		}
+		int exponent = 63;
+		while ((value >> exponent) == 0) {
+			--exponent;
+		}
+		std::size_t sub = static_cast<std::size_t>(value >> (exponent - 4)) & 15;
+		return 16 + (exponent - 4) * 16 + sub;
+	}
+
+	static std::uint64_t upperBound(std::size_t bucket)
+	{
+		if (bucket < 16) {
+			return bucket;
+		}
+		int shift = static_cast<int>((bucket - 16) / 16);
+		std::uint64_t low = (16 + (bucket - 16) % 16) << shift;
+		return low + (std::uint64_t(1) << shift) - 1;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Replay
+
+typedef std::chrono::steady_clock ReplayClock;
+
+// Cost of reading the clock twice, reported so that the smallest latencies
+// can be read in context.
+std::uint64_t timerOverhead()
+{
+	std::uint64_t best = UINT64_MAX;
+	for (int i = 0; i < 10000; ++i) {
+		ReplayClock::time_point start = ReplayClock::now();
+		ReplayClock::time_point stop = ReplayClock::now();
+		best = std::min<std::uint64_t>(best, std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+	}
+	return best;
+}
+
+// Only the Dictionary call is timed; decoding and building the item string
+// happen outside the measured interval.
+int replay(const std::string& path)
+{
+	MappedFile trace(path);
+	TraceReader reader(trace.data(), trace.size());
+	std::vector<LatencyHistogram> histograms(static_cast<std::size_t>(TraceOp::Count));
+	Dictionary dict;
+	std::size_t found = 0;
+
+	TraceRecord record;
+	std::string item;
+	ReplayClock::time_point replayStart = ReplayClock::now();
+	while (reader.next(record)) {
+		item.assign(record.item != nullptr ? record.item : "", record.itemLength);
+		int low = record.key;
+		int high = record.high;
+
+		ReplayClock::time_point start = ReplayClock::now();
+		switch (record.op) {
+		case TraceOp::Insert:
+			dict.insert(record.key, item);
+			break;
+		case TraceOp::Lookup:
+			found += dict.lookup(record.key) != nullptr ? 1 : 0;
+			break;
+		case TraceOp::Remove:
+			dict.remove(record.key);
+			break;
+		case TraceOp::RemoveIfKeys:
+			dict.removeIf([low, high](int key) { return low <= key && key <= high; });
+			break;
+		case TraceOp::RemoveIfItem:
+			dict.removeIf([&item](int, const std::string& value) { return value == item; });
+			break;
+		case TraceOp::Count:
+			break;
+		}
+		ReplayClock::time_point stop = ReplayClock::now();
+		histograms[static_cast<std::size_t>(record.op)].record(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+	}
+	double seconds = std::chrono::duration<double>(ReplayClock::now() - replayStart).count();
+
+	std::uint64_t operations = 0;
+	for (const LatencyHistogram& histogram : histograms) {
+		operations += histogram.samples();
+	}
+	std::cout << "Replayed " << operations << " operations from " << path << " in " << seconds << " s ("
+		<< static_cast<std::uint64_t>(operations / std::max(seconds, 1e-9)) << " ops/sec)" << std::endl;
+	std::cout << "Final size " << dict.size() << ", lookups found " << found
+		<< ", timer overhead " << timerOverhead() << " ns" << std::endl << std::endl;
+
+	std::cout << "operation            count      mean ns    p50 ns    p99 ns   p999 ns    max ns" << std::endl;
+	for (std::size_t op = 0; op < histograms.size(); ++op) {
+		const LatencyHistogram& histogram = histograms[op];
+		if (histogram.samples() == 0) {
+			continue;
+		}
+		std::printf("%-14s %11llu %12.1f %9llu %9llu %9llu %9llu\n", traceOpNames[op],
+			static_cast<unsigned long long>(histogram.samples()), histogram.mean(),
+			static_cast<unsigned long long>(histogram.percentile(0.50)),
+			static_cast<unsigned long long>(histogram.percentile(0.99)),
+			static_cast<unsigned long long>(histogram.percentile(0.999)),
+			static_cast<unsigned long long>(histogram.max()));
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Synthetic Traces
+
+struct GeneratorOptions {
+	std::size_t operations = 1000000;
+	std::size_t keys = 1000000;         // Size of the key space
+	std::string distribution = "uniform";
+	unsigned mix[4] = { 30, 65, 5, 0 }; // Percent insert, lookup, remove, removeIf
+	unsigned seed = 40;
+	bool text = false;
+};
+
+// Draws keys from the configured distribution over [0, keys).
+class KeyStream {
+public:
+	KeyStream(const GeneratorOptions& options, std::mt19937& rng)
+		: rng(rng), keys(options.keys), distribution(options.distribution), next(0)
+	{
+		if (distribution == "zipf") {
+			// Skew 0.99 over ranks, with ranks scattered over the key space.
+			double total = 0;
+			cdf.resize(keys);
+			for (std::size_t rank = 0; rank < keys; ++rank) {
+				total += 1.0 / std::pow(static_cast<double>(rank + 1), 0.99);
+				cdf[rank] = total;
+			}
+			keyForRank.resize(keys);
+			for (std::size_t i = 0; i < keys; ++i) {
+				keyForRank[i] = static_cast<int>(i);
+			}
+			std::shuffle(keyForRank.begin(), keyForRank.end(), rng);
+		}
+		else if (distribution != "uniform" && distribution != "sequential" && distribution != "nearly-sorted") {
+			throw std::runtime_error("unknown distribution '" + distribution + "'");
+		}
+	}
+
+	int operator()()
+	{
+		if (distribution == "zipf") {
+			double target = std::uniform_real_distribution<double>(0.0, cdf.back())(rng);
+			std::size_t rank = std::lower_bound(cdf.begin(), cdf.end(), target) - cdf.begin();
+			return keyForRank[std::min(rank, keys - 1)];
+		}
+		if (distribution == "sequential") {
+			return static_cast<int>(next++ % keys);
+		}
+		if (distribution == "nearly-sorted") {
+			// Ascending, displaced by up to 16 positions either way.
+			long long key = static_cast<long long>(next++ % keys) + static_cast<long long>(rng() % 33) - 16;
+			return static_cast<int>(std::max(0LL, std::min(key, static_cast<long long>(keys) - 1)));
+		}
+		return static_cast<int>(rng() % keys);
+	}
+
+private:
+	std::mt19937& rng;
+	std::size_t keys;
+	std::string distribution;
+	std::size_t next;
+	std::vector<double> cdf;
+	std::vector<int> keyForRank;
+};
+
+int generate(const std::string& path, const GeneratorOptions& options)
+{
+	static const char* const names[] = {
+		"Jane", "Mary", "Harold", "Edward", "Victoria", "Matilda", "Oliver", "Elizabeth",
+	};
+	unsigned total = options.mix[0] + options.mix[1] + options.mix[2] + options.mix[3];
+	if (total == 0 || options.keys == 0) {
+		throw std::runtime_error("the mix and key space must not be empty");
+	}
+	if (options.keys > static_cast<std::size_t>(INT_MAX)) {
+		throw std::runtime_error("the key space must fit in int keys (at most " + std::to_string(INT_MAX) + ")");
+	}
+	std::mt19937 rng(options.seed);
+	KeyStream nextKey(options, rng);
+	TraceWriter writer(path, options.text);
+	// removeIf by key covers about 0.01% of the key space.
+	int span = static_cast<int>(std::max<std::size_t>(1, options.keys / 10000));
+
+	for (std::size_t i = 0; i < options.operations; ++i) {
+		unsigned pick = rng() % total;
+		int key = nextKey();
+		if (pick < options.mix[0]) {
+			writer.write(TraceOp::Insert, key, key, names[key % 8]);
+		}
+		else if (pick < options.mix[0] + options.mix[1]) {
+			writer.write(TraceOp::Lookup, key, key, std::string());
+		}
+		else if (pick < options.mix[0] + options.mix[1] + options.mix[2]) {
+			writer.write(TraceOp::Remove, key, key, std::string());
+		}
+		else if (rng() % 2 == 0) {
+			int high = static_cast<int>(std::min<long long>(static_cast<long long>(key) + span - 1, INT_MAX));
+			writer.write(TraceOp::RemoveIfKeys, key, high, std::string());
+		}
+		else {
+			writer.write(TraceOp::RemoveIfItem, 0, 0, names[rng() % 8]);
+		}
+	}
+	std::cout << "Wrote " << options.operations << " operations (" << options.distribution << " keys over "
+		<< options.keys << ") to " << path << std::endl;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The original manual check: build the sample dictionary and print it.
+int showSample()
 {
 	Dictionary dict;
 
@@ -22,6 +650,68 @@ int main()
 	dict.insert(1, "William");
 	dict.insert(26, "Charles");
 
-	Dictionary dict;
-	
-}
\ No newline at end of file
+	dict.displayTree();
+	return 0;
+}
+
+int usage()
+{
+	std::cerr << "usage: ManualTesting replay <trace>\n"
+		<< "       ManualTesting generate <trace> [--ops N] [--keys N] [--seed N] [--text]\n"
+		<< "           [--dist uniform|zipf|sequential|nearly-sorted] [--mix I,L,R,F]" << std::endl;
+	return 2;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc == 1) {
+		return showSample();
+	}
+	try {
+		std::string command = argv[1];
+		if (command == "replay" && argc == 3) {
+			return replay(argv[2]);
+		}
+		if (command != "generate" || argc < 3) {
+			return usage();
+		}
+
+		GeneratorOptions options;
+		for (int i = 3; i < argc; ++i) {
+			std::string flag = argv[i];
+			if (flag == "--text") {
+				options.text = true;
+				continue;
+			}
+			if (i + 1 == argc) {
+				return usage();
+			}
+			std::string value = argv[++i];
+			if (flag == "--ops") {
+				options.operations = std::strtoull(value.c_str(), nullptr, 10);
+			}
+			else if (flag == "--keys") {
+				options.keys = std::strtoull(value.c_str(), nullptr, 10);
+			}
+			else if (flag == "--seed") {
+				options.seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+			}
+			else if (flag == "--dist") {
+				options.distribution = value;
+			}
+			else if (flag == "--mix") {
+				if (std::sscanf(value.c_str(), "%u,%u,%u,%u", &options.mix[0], &options.mix[1], &options.mix[2], &options.mix[3]) != 4) {
+					return usage();
+				}
+			}
+			else {
+				return usage();
+			}
+		}
+		return generate(argv[2], options);
+	}
+	catch (const std::exception& error) {
+		std::cerr << "error: " << error.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef BATCHED_WRITER_H
+#define BATCHED_WRITER_H
+
+#include "Dictionary.h"
+#include <string>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Write-buffering front end for a Dictionary. Producer threads append writes
+// to their own lock-free queue and return at once; a single applier thread
+// drains the queues, sorts each batch by key, keeps only the last write to
+// each key, and applies the batch in one pass with Dictionary::applyBatch.
+//
+// Every write gets a ticket from a global sequence, which orders writes to
+// the same key across producers. await(ticket) blocks until that write has
+// been applied; flush() waits for every write submitted before it. If
+// applying a batch throws, its writes may be partly applied and the next
+// await or flush to return rethrows the exception.
+//
+// The applier holds 'targetLock' while it modifies the target, so readers
+// that take the same mutex see whole batches.
+class BatchedWriter {
+    struct Queue;
+
+public:
+    // A producer's queue. Each thread should use its own producer; the
+    // producer stays valid for the lifetime of the writer.
+    class Producer {
+    public:
+        std::uint64_t insert(int key, const std::string& item); // Returns the write's ticket
+        std::uint64_t remove(int key);
+
+    private:
+        friend class BatchedWriter;
+        Producer(BatchedWriter& owner, Queue& queue);
+
+        BatchedWriter& owner;
+        Queue& queue;
+    };
+
+    struct BatchStats {
+        std::size_t batches;
+        std::size_t writes;    // Writes submitted by producers
+        std::size_t collapsed; // Writes superseded within their batch and never applied
+    };
+
+    BatchedWriter(Dictionary& target, std::mutex& targetLock);
+    ~BatchedWriter(); // Flushes outstanding writes, then stops the applier
+    BatchedWriter(const BatchedWriter&) = delete;
+    BatchedWriter& operator=(const BatchedWriter&) = delete;
+
+    Producer& producer(); // Registers a new queue
+    void await(std::uint64_t ticket);
+    void flush();
+    BatchStats stats() const;
+
+private:
+    struct Record {
+        std::uint64_t ticket;
+        int key;
+        bool erase;
+        std::string item;
+    };
+
+    Dictionary& target;
+    std::mutex& targetLock;
+
+    std::atomic<std::uint64_t> nextTicket;
+    std::atomic<std::uint64_t> appliedTickets; // Every ticket below this is applied
+    std::atomic<bool> stopping;
+
+    mutable std::mutex stateMutex; // Guards producers, stats and waiting for batches
+    std::condition_variable batchApplied;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::unique_ptr<Producer>> producers;
+    BatchStats counters;
+    std::exception_ptr failure; // From the applier, not yet rethrown to a waiter
+
+    std::thread applier;
+
+    std::uint64_t submit(Queue& queue, int key, bool erase, const std::string& item);
+    void applyLoop();
+    bool drainBatch(std::vector<Record>& pending, std::vector<Record>& batch);
+    void applyRecords(std::vector<Record>& batch);
+    void rethrowFailure();
+};
+
+#endif // BATCHED_WRITER_H
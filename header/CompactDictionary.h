@@ -0,0 +1,77 @@
+#pragma once
+#ifndef COMPACT_DICTIONARY_H
+#define COMPACT_DICTIONARY_H
+
+#include <string>
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Alternative Dictionary engine with a hot/cold split: the search path only
+// touches 12-byte index nodes (key and two 32-bit child indices) packed in
+// one array, while items live out of line in a value store at the same
+// index. Five index nodes share a cache line, against one or two Dictionary
+// nodes. Exposes the same core API as Dictionary; select it at compile time
+// through DictionaryEngine.h.
+//
+// Links are 32-bit indices into the node arena rather than pointers, which
+// halves their cost and makes the index position-independent: a copy is one
+// block copy of the arena plus a copy of the live items.
+class CompactDictionary {
+public:
+    CompactDictionary();
+
+    CompactDictionary(const CompactDictionary&);
+    CompactDictionary(CompactDictionary&&);
+    CompactDictionary& operator=(const CompactDictionary& other);
+    CompactDictionary& operator=(CompactDictionary&& other);
+
+    void insert(int key, const std::string& item);
+    std::size_t size() const;
+    std::string* lookup(int key); // Stable until the key is removed
+    void displayEntries();
+    void displayTree();
+    void remove(int key);
+    void removeIf(std::function<bool(int)> predicate);
+    void removeIf(std::function<bool(int, const std::string&)> predicate); // Sees each key and item
+    void reserve(std::size_t entries); // Pre-size the arena to avoid regrowth at scale
+
+    static const std::size_t maxEntries = 0xFFFFFFFE; // Indices are 32-bit; one value means null
+
+    // Bytes held by the index and the value store, counting free slots.
+    struct MemoryStats {
+        std::size_t indexBytes;
+        std::size_t itemBytes;
+    };
+    MemoryStats memoryStats() const;
+
+private:
+    static const std::uint32_t none = 0xFFFFFFFF; // Null child index
+
+    struct IndexNode {
+        int key;
+        std::uint32_t left;
+        std::uint32_t right;
+    };
+    static_assert(std::is_trivially_copyable<IndexNode>::value, "copies rely on a block copy of the arena");
+
+    std::vector<IndexNode> nodes;
+    std::deque<std::string> items; // items[i] belongs to nodes[i]; a deque never moves them
+    std::vector<std::uint32_t> freeSlots; // Indices of removed nodes, reused by insert
+    std::uint32_t root;
+    std::size_t count;
+
+    std::uint32_t allocateSlot(int key, const std::string& item);
+    void releaseSlot(std::uint32_t slot);
+    std::uint32_t detachMin(std::uint32_t& link); // Unlink and return the minimum of a non-empty subtree
+    void collectKeysToRemove(std::uint32_t node, const std::function<bool(int, const std::string&)>& predicate, std::vector<int>& keysToRemove);
+    void displayEntriesWorker(std::uint32_t node);
+    void displayTreeWorker(std::uint32_t node, int depth);
+    void printIndent(int depth);
+};
+
+#endif // COMPACT_DICTIONARY_H
@@ -6,9 +6,17 @@
 #include <iostream>
 #include <functional>
 #include <vector>
+#include <cstddef>
+#include <chrono>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
 
 class Dictionary {
 public:
+    typedef std::chrono::steady_clock Clock;
+
     Dictionary();  // Default constructor declaration
     ~Dictionary();  // Destructor declaration
 
@@ -20,12 +28,141 @@ public:
     Dictionary& operator=(Dictionary&& other);
 
     void insert(int key, const std::string& item);
+    void insert(int key, const std::string& item, Clock::duration ttl); // Expires after 'ttl'
+    std::size_t size() const; // Number of entries
+    // The item may be read through the pointer, but writing through it
+    // bypasses the content hashes and the item index: contentEquals and diff
+    // go on using the old item, and checkInvariants reports the stale hash.
+    // Change items with insert.
     std::string* lookup(int key);
     void displayEntries();
     void displayTree();
+    void forEach(const std::function<void(int, const std::string&)>& visit) const; // In key order
     void remove(int key);
     void testRotations(); // Temporary function for testing rotations
     void removeIf(std::function<bool(int)> predicate); // Higher-order function declaration
+    void removeIf(std::function<bool(int, const std::string&)> predicate); // Sees each key and item
+    // Evaluates the predicate on 'threads' threads (0 = one per core): the
+    // caller and workers from a pool shared by every dictionary and kept
+    // between calls, so the predicate must be safe to call concurrently. The
+    // survivors are then relinked into a balanced tree. If the predicate
+    // throws, the first exception is rethrown here once every thread has
+    // stopped, and the dictionary is left unchanged.
+    void removeIfParallel(std::function<bool(int, const std::string&)> predicate, unsigned threads = 0);
+
+    // Hot-key lookup cache: a direct-mapped table of recently found nodes
+    // consulted before descending the tree. Disabled by default.
+    struct CacheStats {
+        std::size_t hits;
+        std::size_t misses;
+    };
+    void enableLookupCache(std::size_t slots); // Rounded up to a power of two
+    void disableLookupCache();
+    CacheStats cacheStats() const;
+
+    // Approximate-membership filter: a counting Bloom filter kept alongside
+    // the tree so lookups of absent keys usually return without touching any
+    // node. It is derived from the contents, so it is copied and moved with
+    // them, and rebuilt at twice the capacity once the entry count outgrows it.
+    struct FilterStats {
+        std::size_t counters;       // One byte each
+        std::size_t hashFunctions;
+        std::size_t memoryBytes;
+        double falsePositiveRate;   // Expected rate at the current entry count
+        std::size_t negatives;      // Lookups answered by the filter alone
+        std::size_t falsePositives; // Lookups the filter passed that missed in the tree
+        std::size_t rebuilds;
+    };
+    void enableMembershipFilter(std::size_t expectedEntries, double falsePositiveRate); // Rate in (0, 1), else std::invalid_argument
+    void disableMembershipFilter();
+    FilterStats filterStats() const;
+
+    // Bounded mode: once an entry or byte limit is set, entries are threaded
+    // on an intrusive recency list and insert evicts the least recently used
+    // ones. Entries inserted with a TTL are also kept in a time-ordered index;
+    // expired entries are dropped on lookup, on insert and by removeExpired.
+    struct EvictionStats {
+        std::size_t evictions;   // Entries dropped to respect the limits
+        std::size_t expirations; // Entries dropped because their TTL passed
+        std::size_t bytes;       // Current estimate of bytes held by entries
+    };
+    void setCapacity(std::size_t entryLimit, std::size_t byteLimit = 0); // 0 = no limit
+    std::size_t removeExpired(); // Returns the number of entries dropped
+    EvictionStats evictionStats() const;
+
+    // Hybrid hash index: an open-addressing table from key to node kept next
+    // to the tree, so lookup is O(1) while ordered operations use the tree.
+    // Like the filter it is derived from the contents and travels with them.
+    struct IndexStats {
+        std::size_t slots;
+        std::size_t memoryBytes;
+        double loadFactor;
+    };
+    void enableHashIndex();
+    void disableHashIndex();
+    IndexStats hashIndexStats() const;
+
+    // Item index: a secondary index from item to the keys holding it, for
+    // reverse lookups without a traversal. Like the hash index it is derived
+    // from the contents and travels with them; every write keeps it in step,
+    // but items changed through the pointer lookup returns are not seen.
+    // Each item's keys form a compact set: a sorted array while small, then
+    // grouped by their high 16 bits into sorted arrays of the low halves, or
+    // bitmaps once a group is dense.
+    struct ItemIndexStats {
+        std::size_t items;       // Distinct items
+        std::size_t memoryBytes; // Approximate, including the items' text
+    };
+    void enableItemIndex();
+    void disableItemIndex();
+    std::vector<int> keysFor(const std::string& item) const; // Ascending; traverses when disabled
+    ItemIndexStats itemIndexStats() const;
+
+    // Batched writes: one pass over the tree for a run of writes sorted by
+    // strictly ascending key. Each key is found by resuming from the path to
+    // the previous one rather than from the root.
+    struct BatchWrite {
+        int key;
+        bool erase; // Remove the key instead of inserting 'item'
+        std::string item;
+    };
+    void applyBatch(const std::vector<BatchWrite>& writes);
+
+    // Write cursor for streams of nearby keys, such as mostly ascending
+    // ingest. It keeps the path to the last key it wrote and resumes from the
+    // deepest saved link whose key range holds the next key, so a key d
+    // positions away costs O(1 + log d) on a balanced tree instead of a walk
+    // from the root. Anything that unlinks nodes sends it back to the root.
+    class InsertCursor;
+
+    // Online compaction: rebalance with Day-Stout-Warren rotations (flatten
+    // into a sorted vine, then fold it into a complete tree) in O(n) time and
+    // O(1) extra space, then move every node, in key order, into one
+    // contiguous block, so searches walk nearby memory. compactFor does at
+    // most about 'budget' of that work and returns true once it is finished;
+    // later calls resume, or start over if the dictionary changed in between,
+    // so a live service can spread it over idle slices. The tree stays valid
+    // between slices. Moving a node invalidates pointers from lookup.
+    void compact();
+    bool compactFor(Clock::duration budget);
+
+    // Content hashes: every node carries the sum of a 64-bit hash of each
+    // entry in its subtree, kept current along the path of every write and
+    // through rotations. Batch and cursor writes defer the sums above them
+    // until their path moves away, so they keep their per-key cost; anything
+    // that reads the sums or reshapes the tree applies the rest first. A sum
+    // does not depend on the tree's shape, so replicas built in any order
+    // compare in O(1), and diff only descends into key ranges whose sums
+    // differ: O(d log n) for d differences when the shapes match, more when
+    // they do not. Different contents with equal sums are possible but
+    // vanishingly unlikely outside adversarial data.
+    std::uint64_t contentHash() const;
+    bool contentEquals(const Dictionary& other) const;
+    std::vector<int> diff(const Dictionary& other) const; // Keys missing from one side or with other items, ascending
+
+    // Consistency checks for tests and fuzzing; both walk the whole tree.
+    std::string checkInvariants() const; // First broken invariant, or empty
+    std::size_t height() const;          // Nodes on the longest root-to-leaf path
 private:
 
     struct Node {
@@ -33,25 +170,199 @@ private:
         std::string item;
         Node* left;
         Node* right;
+        Node* lruPrev; // Recency list, threaded only in bounded mode
+        Node* lruNext;
+        Clock::time_point expiresAt;
+        std::uint64_t subtreeHash; // Sum of entryHash over the subtree
 
         Node(int key, const std::string& item, Node* next = nullptr)
-            : key(key), item(item), left(nullptr), right(nullptr) {}
+            : key(key), item(item), left(nullptr), right(nullptr),
+              lruPrev(nullptr), lruNext(nullptr), expiresAt(Clock::time_point::max()), subtreeHash(0) {}
     };
 
     Node* root;
+    std::size_t count;
+    std::size_t byteCount;
+
+    struct CacheSlot {
+        int key;
+        Node* node; // nullptr marks an empty slot
+    };
+    std::vector<CacheSlot> lookupCache;
+    std::size_t cacheHitCount;
+    std::size_t cacheMissCount;
+
+    struct CountingBloomFilter {
+        std::vector<unsigned char> counters; // Saturating; empty when disabled
+        std::size_t hashes = 0;
+        std::size_t capacity = 0;
+        double targetRate = 0;
+        std::size_t negatives = 0;
+        std::size_t falsePositives = 0;
+        std::size_t rebuilds = 0;
+
+        void configure(std::size_t expectedEntries, double falsePositiveRate);
+        void add(int key);
+        void remove(int key);
+        bool mayContain(int key) const;
+        std::size_t counterFor(unsigned long long hash, std::size_t i) const;
+    };
+    CountingBloomFilter filter;
+
+    std::size_t maxEntries;
+    std::size_t maxBytes;
+    Node* lruHead; // Most recently used
+    Node* lruTail; // Next to be evicted
+    std::set<std::pair<Clock::time_point, int>> expiryIndex;
+    std::size_t evictionCount;
+    std::size_t expirationCount;
+    Node* lastInserted; // Node written by the latest insertWorker call
+    std::size_t shapeVersion; // Bumped whenever nodes are unlinked or relinked
+    std::uint64_t lastHashDelta; // Change in subtree hashes from the latest insert or remove worker
+
+    // A child link on a search path, with the open key range of its subtree.
+    // Writes through a saved path defer the hash updates of the nodes above
+    // them: 'pending' is owed to the node at the link, and passes to the link
+    // above when this one is popped or settled.
+    struct PathLink {
+        Node** link;
+        long long lower; // Every key below the link is greater
+        long long upper; // and smaller than this
+        std::uint64_t pending;
+    };
+    mutable std::vector<PathLink>* deferredPath; // The path holding pending hash deltas, if any
+
+    // Linear probing with backward-shift deletion, kept at most half full.
+    struct NodeHashIndex {
+        struct Slot {
+            int key;
+            Node* node; // nullptr marks an empty slot
+        };
+        std::vector<Slot> slots; // Empty when disabled
+        std::size_t used = 0;
+
+        void reset(std::size_t expectedEntries);
+        void insert(Node* node);
+        void erase(int key);
+        Node* find(int key) const;
+        std::size_t home(int key) const;
+    };
+    NodeHashIndex hashIndex;
+
+    // Keys sharing one item: a sorted array while there are few, then
+    // containers sorted by the keys' high 16 bits.
+    struct ItemKeySet {
+        struct Container {
+            std::uint16_t high;
+            std::size_t size;
+            std::vector<std::uint16_t> array;  // Sorted low halves while sparse
+            std::vector<std::uint64_t> bitmap; // 65536 bits once dense
+        };
+        std::vector<int> small; // Used while 'containers' is empty
+        std::vector<Container> containers;
+        std::size_t count = 0;
+
+        void add(int key);
+        void addToContainer(int key);
+        void remove(int key);
+        bool contains(int key) const;
+        void appendTo(std::vector<int>& keys) const; // In ascending order
+        std::size_t memoryBytes() const; // Held outside the object itself
+    };
+
+    struct ItemIndex {
+        bool enabled = false;
+        std::unordered_map<std::string, ItemKeySet> sets; // Only items some key holds
+
+        void add(const std::string& item, int key);
+        void remove(const std::string& item, int key);
+    };
+    ItemIndex itemIndex;
+
+    // Block of nodes laid out by compaction, released once its last node is.
+    struct NodeSlab {
+        Node* nodes;
+        std::size_t capacity;
+        std::size_t used; // Slots handed out, constructed in order
+        std::size_t live;
+    };
+    std::vector<NodeSlab> slabs;
+
+    // Where a paused compaction resumes, valid while the dictionary still has
+    // the shape version and count it recorded.
+    struct CompactionState {
+        enum class Phase { Idle, Vine, Compress, Relocate };
+        Phase phase = Phase::Idle;
+        Node** link = nullptr;          // Vine tail, next rotation, or relocation cursor
+        std::size_t rotations = 0;      // Left in the current compression pass
+        std::size_t nextPass = 0;       // Vine length the next pass folds
+        std::vector<Node**> pending;    // Relocation: links of nodes still to visit
+        std::size_t version = 0;
+        std::size_t count = 0;
+    };
+    CompactionState compaction;
 
     void displayEntriesWorker(Node* currentNode);
+    static void forEachWorker(const Node* node, const std::function<void(int, const std::string&)>& visit);
     void displayTreeWorker(Node* node, int depth);
     void printIndent(int depth);
-    std::string* lookupWorker(Node* currentNode, int key);
+    Node* lookupWorker(Node* currentNode, int key);
+    Node* filteredLookup(int key);
+    Node* cachedLookup(int key);
+    void insertEntry(Node** link, int key, const std::string& item, Clock::time_point expiresAt,
+        std::vector<PathLink>* path = nullptr);
+    static Node** seekPath(std::vector<PathLink>& path, int key);
+    void growFilterIfNeeded();
     Node* insertWorker(Node* node, int key, const std::string& item);
     Node* removeWorker(Node* node, int key);
-    Node* findAndDetachMinNode(Node* node);
+    Node* findAndDetachMinNode(Node*& node);
+    void deleteEntry(Node* node);
     void deepDeleteWorker(Node*); // recursive worker performing deep delete
     Node* copyTree(Node*);
     Node* rotateLeft(Node* a);
     Node* rotateRight(Node* a);
-    void collectKeysToRemove(Node* node, std::function<bool(int)> predicate, std::vector<int>& keysToRemove);
+    bool compactStep();
+    Node* relocate(Node* node);
+    void freeNode(Node* node);
+    std::size_t cacheSlotFor(int key) const;
+    void invalidateCachedKey(int key);
+    void clearLookupCache();
+    void addToFilterWorker(Node* node);
+    static double blockedFalsePositiveRate(std::size_t n, std::size_t m, std::size_t k);
+    static std::size_t entryBytes(const Node* node);
+    bool isBounded() const;
+    void pushLruFront(Node* node);
+    void unlinkLru(Node* node);
+    void threadLruWorker(Node* node);
+    void copyBoundedState(const Dictionary& other);
+    void resetBoundedState();
+    void enforceBounds(Node* keep);
+    void indexTreeWorker(Node* node);
+    void collectKeysToRemove(Node* node, const std::function<bool(int, const std::string&)>& predicate, std::vector<int>& keysToRemove);
+    static Node* buildBalanced(const std::vector<Node*>& nodes, std::size_t begin, std::size_t end);
+    struct WorkerPool;
+    static WorkerPool& workerPool();
+    static std::uint64_t entryHash(int key, const std::string& item);
+    static std::uint64_t subtreeHashOf(const Node* node);
+    static std::uint64_t ownHash(const Node* node);
+    static void deferAlongPath(std::vector<PathLink>& path, std::uint64_t delta);
+    static void settleLink(std::vector<PathLink>& path, std::size_t i);
+    void settleHashes() const;
+};
+
+class Dictionary::InsertCursor {
+public:
+    explicit InsertCursor(Dictionary& dict);
+    ~InsertCursor(); // Applies its deferred hash updates; must run before the dictionary's destructor
+    InsertCursor(const InsertCursor&) = delete;
+    InsertCursor& operator=(const InsertCursor&) = delete;
+
+    void insert(int key, const std::string& item); // Same effect as Dictionary::insert
+
+private:
+    Dictionary& dict;
+    std::vector<PathLink> path; // From the root link down to the last key written
+    std::size_t version;        // The dictionary's shape version the path belongs to
 };
 
 #endif // DICTIONARY_H
\ No newline at end of file
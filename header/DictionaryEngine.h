@@ -0,0 +1,20 @@
+#pragma once
+#ifndef DICTIONARY_ENGINE_H
+#define DICTIONARY_ENGINE_H
+
+// Compile-time choice of the engine behind DictionaryEngine. The binary
+// search tree is the default; define DICTIONARY_ENGINE_RADIX to use the
+// radix trie, which suits dense ranges of int keys, or
+// DICTIONARY_ENGINE_COMPACT for the tree with a hot/cold node split.
+#if defined(DICTIONARY_ENGINE_RADIX)
+#include "RadixDictionary.h"
+typedef RadixDictionary DictionaryEngine;
+#elif defined(DICTIONARY_ENGINE_COMPACT)
+#include "CompactDictionary.h"
+typedef CompactDictionary DictionaryEngine;
+#else
+#include "Dictionary.h"
+typedef Dictionary DictionaryEngine;
+#endif
+
+#endif // DICTIONARY_ENGINE_H
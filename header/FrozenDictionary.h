@@ -0,0 +1,96 @@
+#pragma once
+#ifndef FROZEN_DICTIONARY_H
+#define FROZEN_DICTIONARY_H
+
+#include "Dictionary.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Read-only copy of a Dictionary for read-mostly periods after a bulk load.
+// The search structure is rebuilt into one contiguous buffer, optionally
+// backed by huge pages, in one of four layouts:
+//
+//  - Sorted: keys in order, binary search. Each probe of a large search
+//    lands on a different page.
+//  - Eytzinger: keys in breadth-first order of an implicit complete tree.
+//    The top levels share cache lines, but deep levels still hop pages.
+//  - VanEmdeBoas: nodes of a complete tree in recursive van Emde Boas order
+//    (top half, then each bottom subtree, recursively), with explicit child
+//    indices. Every subtree of height h occupies one run of 2^h - 1 nodes,
+//    so a search touches O(log_B n) blocks for any block size B: cache
+//    lines, pages and TLB reach alike, without tuning.
+//  - Packed: compressed keys for large archives. Keys are cut into blocks of
+//    128; each block stores the gaps between consecutive keys, less the
+//    block's smallest gap, bit-packed at the width of its largest remainder
+//    (delta plus frame of reference), so dense runs cost no bits at all. A
+//    top index of each block's first key is searched by interpolation, and
+//    only the one block is decoded.
+//
+// Items are kept out of line in the same order as the search structure.
+class FrozenDictionary {
+public:
+    enum class Layout { Sorted, Eytzinger, VanEmdeBoas, Packed };
+
+    FrozenDictionary(const Dictionary& source, Layout layout, bool useHugePages = true);
+    ~FrozenDictionary();
+    FrozenDictionary(const FrozenDictionary&) = delete;
+    FrozenDictionary& operator=(const FrozenDictionary&) = delete;
+
+    void rebuild(const Dictionary& source); // Re-freeze after the source changed
+    const std::string* lookup(int key) const;
+    std::size_t size() const;
+
+    Layout layout() const;
+    bool hugePages() const;          // Whether huge pages back the buffer now; on Linux
+                                     // this reads /proc/self/smaps, so keep it off hot paths
+    std::size_t bufferBytes() const; // Search structure only, excluding items
+
+private:
+    struct VebNode {
+        int key;
+        std::uint32_t left;  // Positions in the buffer; 'none' for no child
+        std::uint32_t right;
+    };
+    static const std::uint32_t none = 0xFFFFFFFF;
+
+    struct PackedBlock {
+        std::uint32_t words;    // Offset of the block's bits in the word array
+        std::uint32_t minDelta; // Subtracted from every gap less one
+        std::uint32_t width;    // Bits per packed gap, 0 to 32
+    };
+    static const std::size_t packedBlockKeys = 128;
+
+    Layout shape;
+    bool wantHugePages;
+    bool gotHugePages;    // Granted on Windows; on Linux only advised
+    void* buffer;         // int keys for Sorted and Eytzinger, VebNode for VanEmdeBoas,
+                          // the sections below for Packed
+    std::size_t capacity; // Bytes mapped for 'buffer'
+    std::size_t count;
+    std::size_t usedBytes; // Of 'buffer', before rounding to pages
+
+    // Packed sections of 'buffer': first keys, block headers, then words.
+    std::size_t blockCount;
+    std::size_t headersAt;
+    std::size_t wordsAt;
+    std::vector<std::string> items; // items[i] belongs to buffer position i
+
+    FrozenDictionary(Layout layout, bool useHugePages); // Empty, for rebuild
+    void swap(FrozenDictionary& other);
+    void allocate(std::size_t bytes);
+    void release();
+    void buildSorted(const std::vector<int>& keys, std::vector<std::string>& sortedItems);
+    void buildEytzinger(const std::vector<int>& keys, std::vector<std::string>& sortedItems);
+    void buildVanEmdeBoas(const std::vector<int>& keys, std::vector<std::string>& sortedItems);
+    void buildPacked(const std::vector<int>& keys, std::vector<std::string>& sortedItems);
+    const std::string* lookupPacked(int key) const;
+#if defined(__linux__)
+    static std::size_t anonHugePageBytes(const void* address);
+#endif
+    static void bfsToInOrder(std::size_t bfs, std::size_t n, std::size_t& next, std::vector<std::size_t>& rank);
+    static void vebOrder(std::size_t bfs, int height, std::size_t n, std::vector<std::size_t>& order);
+};
+
+#endif // FROZEN_DICTIONARY_H
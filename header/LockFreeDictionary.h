@@ -0,0 +1,97 @@
+#pragma once
+#ifndef LOCK_FREE_DICTIONARY_H
+#define LOCK_FREE_DICTIONARY_H
+
+#include <string>
+#include <functional>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Ordered Dictionary engine for write-heavy multicore workloads: a lock-free
+// skip list (Herlihy & Shavit / Fraser). Nodes are removed by marking the low
+// bit of their next pointers, then unlinked by any thread that walks past
+// them, so no operation ever waits for another. Unlinked nodes and replaced
+// items are freed by epoch-based reclamation once no running operation can
+// still reach them.
+//
+// lookup returns a copy of the item, since another thread may replace or
+// remove it as soon as the call returns. At most maxThreads operations hold
+// a reclamation slot at once; further callers spin until one is released.
+class LockFreeDictionary {
+    struct Node;
+
+public:
+    LockFreeDictionary();
+    ~LockFreeDictionary();
+    LockFreeDictionary(const LockFreeDictionary&) = delete;
+    LockFreeDictionary& operator=(const LockFreeDictionary&) = delete;
+
+    void insert(int key, const std::string& item); // Overwrites an existing item
+    bool lookup(int key, std::string& item) const; // Copies the item, if present
+    void remove(int key);
+    void removeIf(std::function<bool(int)> predicate);
+    std::size_t size() const; // Exact once concurrent writers have finished
+
+    static const std::size_t maxThreads = 256;
+
+private:
+    static const int maxLevel = 24; // Plenty for 2^24 entries at p = 1/2
+
+    // Retired object awaiting reclamation; exactly one pointer is set.
+    struct Retired {
+        std::uint64_t epoch;
+        Node* node;
+        const std::string* item;
+    };
+
+    // An operation owns a slot while it runs and announces the epoch it
+    // started in. Retired objects stay with the slot until they are safe.
+    struct Slot {
+        std::atomic<std::uint64_t> epoch; // 0 marks a free slot
+        std::vector<Retired> retired;     // Touched only by the slot's owner
+        char padding[64];                 // Keep slots on separate cache lines
+    };
+
+    // Pins a slot for the lifetime of one operation.
+    class Guard {
+    public:
+        explicit Guard(const LockFreeDictionary& owner);
+        ~Guard();
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        void retire(Node* node);
+        void retire(const std::string* item);
+
+    private:
+        const LockFreeDictionary& owner;
+        Slot& slot;
+
+        void reclaim();
+    };
+
+    Node* head; // Sentinel of full height; the lists end in nullptr
+    std::atomic<std::size_t> count;
+    mutable std::atomic<std::uint64_t> epoch;
+    mutable Slot slots[maxThreads];
+
+    Slot& pin() const;
+
+    // Next pointers carry the removal mark in their low bit.
+    static bool isMarked(std::uintptr_t next);
+    static Node* pointer(std::uintptr_t next);
+    static std::uintptr_t bits(const Node* node);
+
+    static Node* createNode(int key, const std::string* item, int height);
+    static void destroyNode(Node* node);
+    static int randomHeight();
+
+    Node* find(int key, Node** preds, Node** succs) const;
+    bool findOnce(int key, Node** preds, Node** succs) const;
+    void linkUpperLevels(Node* node, Node** preds, Node** succs) const;
+    void releaseNode(Node* node, Guard& guard) const;
+};
+
+#endif // LOCK_FREE_DICTIONARY_H
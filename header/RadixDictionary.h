@@ -0,0 +1,98 @@
+#pragma once
+#ifndef RADIX_DICTIONARY_H
+#define RADIX_DICTIONARY_H
+
+#include <string>
+#include <iostream>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+// Alternative Dictionary engine for dense ranges of int keys: a 256-ary radix
+// trie with one level per key byte, so every operation is O(key bytes) (four
+// steps) instead of O(depth) comparisons. Exposes the same core API as
+// Dictionary; select it at compile time through DictionaryEngine.h.
+//
+// Nodes are fixed 256-way and leaves hold their items inline, which is
+// compact for dense key ranges but wasteful for sparse ones.
+class RadixDictionary {
+public:
+    RadixDictionary();
+    ~RadixDictionary();
+
+    RadixDictionary(const RadixDictionary&);
+    RadixDictionary(RadixDictionary&&);
+    RadixDictionary& operator=(const RadixDictionary& other);
+    RadixDictionary& operator=(RadixDictionary&& other);
+
+    void insert(int key, const std::string& item);
+    std::size_t size() const;
+    std::string* lookup(int key);
+    void displayEntries(); // In key order
+    void displayTree();
+    void remove(int key);
+    void removeIf(std::function<bool(int)> predicate);
+    void removeIf(std::function<bool(int, const std::string&)> predicate); // Sees each key and item
+
+private:
+    static const unsigned fanout = 256;
+
+    // Occupancy bitmap shared by every node type.
+    struct Bitmap {
+        std::uint64_t words[fanout / 64];
+
+        bool test(unsigned i) const;
+        void set(unsigned i);
+        void clear(unsigned i);
+    };
+
+    // Last key byte: items are stored inline, so lookup returns a stable pointer.
+    struct Leaf {
+        Bitmap present;
+        unsigned count;
+        std::string items[fanout];
+    };
+
+    template <typename Child>
+    struct Inner {
+        Bitmap present;
+        unsigned count;
+        Child* children[fanout];
+    };
+
+    typedef Inner<Leaf> Level1;   // Second-lowest key byte
+    typedef Inner<Level1> Level2;
+    typedef Inner<Level2> Level3; // Highest key byte (the root)
+
+    Level3* root;
+    std::size_t count;
+
+    static unsigned keyByte(int key, int byte); // Bytes of the order-preserving unsigned key
+    static int keyFromPrefix(std::uint32_t prefix);
+
+    // Each worker has a Leaf overload and an Inner template with the same
+    // parameters, so the recursion is resolved per level at compile time.
+    static void deleteWorker(Leaf* leaf);
+    template <typename Child> static void deleteWorker(Inner<Child>* node);
+    static Leaf* copyWorker(const Leaf* leaf);
+    template <typename Child> static Inner<Child>* copyWorker(const Inner<Child>* node);
+
+    void insertWorker(Leaf* leaf, int key, int byte, const std::string& item);
+    template <typename Child> void insertWorker(Inner<Child>* node, int key, int byte, const std::string& item);
+    std::string* lookupWorker(Leaf* leaf, int key, int byte);
+    template <typename Child> std::string* lookupWorker(Inner<Child>* node, int key, int byte);
+    bool removeWorker(Leaf* leaf, int key, int byte); // Returns true once the node is empty
+    template <typename Child> bool removeWorker(Inner<Child>* node, int key, int byte);
+    template <typename Child> static void dropChild(Inner<Child>* node, unsigned i); // Frees an emptied child
+
+    bool removeIfWorker(Leaf* leaf, std::uint32_t prefix, const std::function<bool(int, const std::string&)>& predicate);
+    template <typename Child>
+    bool removeIfWorker(Inner<Child>* node, std::uint32_t prefix, const std::function<bool(int, const std::string&)>& predicate);
+
+    void displayWorker(const Leaf* leaf, std::uint32_t prefix, int depth, bool tree);
+    template <typename Child>
+    void displayWorker(const Inner<Child>* node, std::uint32_t prefix, int depth, bool tree);
+    void printIndent(int depth);
+};
+
+#endif // RADIX_DICTIONARY_H
@@ -0,0 +1,131 @@
+#pragma once
+#ifndef STATIC_DICTIONARY_H
+#define STATIC_DICTIONARY_H
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+struct StaticEntry {
+    int key;
+    std::string_view item;
+};
+
+// Dictionary for fixed tables known at build time. The constructor is
+// constexpr, so a table declared 'static constexpr' is sorted and laid out
+// by the compiler and lives in read-only data: no allocation and no
+// initialisation at startup.
+//
+//     static constexpr StaticEntry entries[] = { { 22, "Jane" }, { 0, "Harold" } };
+//     static constexpr StaticDictionary table(entries);
+//     const std::string_view* item = table.lookup(22);
+//
+// As with repeated Dictionary::insert, the last entry for a key wins. Keys
+// are stored in Eytzinger (breadth-first) order, apart from the items, so
+// the top levels of every search share cache lines. Building takes
+// O(N log N) steps in the compiler's constant evaluator. Needs C++17.
+template <std::size_t N>
+class StaticDictionary {
+public:
+    constexpr explicit StaticDictionary(const StaticEntry (&entries)[N]) : keys{}, items{}, count(0) {
+        build(entries);
+    }
+
+    constexpr explicit StaticDictionary(const std::array<StaticEntry, N>& entries) : keys{}, items{}, count(0) {
+        build(entries.data());
+    }
+
+    constexpr const std::string_view* lookup(int key) const {
+        std::size_t i = 1;
+        while (i <= count) {
+            int current = keys[i - 1];
+            if (current == key) {
+                return &items[i - 1];
+            }
+            i = 2 * i + (key > current ? 1 : 0);
+        }
+        return nullptr;
+    }
+
+    constexpr std::size_t size() const {
+        return count;
+    }
+
+private:
+    std::array<int, N> keys;              // Eytzinger order, 'count' used
+    std::array<std::string_view, N> items; // items[i] belongs to keys[i]
+    std::size_t count;
+
+    constexpr void build(const StaticEntry* entries) {
+        // Sort positions by (key, position), so the last entry of each run of
+        // equal keys is the one that wins.
+        std::array<std::size_t, N> order{};
+        for (std::size_t i = 0; i < N; ++i) {
+            order[i] = i;
+        }
+        heapSort(entries, order);
+
+        std::array<std::size_t, N> unique{};
+        for (std::size_t i = 0; i < N; ++i) {
+            if (i + 1 == N || entries[order[i + 1]].key != entries[order[i]].key) {
+                unique[count++] = order[i];
+            }
+        }
+
+        std::size_t next = 0;
+        place(entries, unique, 1, next);
+    }
+
+    // In-order walk of the implicit complete tree, handing out sorted entries.
+    constexpr void place(const StaticEntry* entries, const std::array<std::size_t, N>& unique, std::size_t i, std::size_t& next) {
+        if (i > count) {
+            return;
+        }
+        place(entries, unique, 2 * i, next);
+        keys[i - 1] = entries[unique[next]].key;
+        items[i - 1] = entries[unique[next]].item;
+        ++next;
+        place(entries, unique, 2 * i + 1, next);
+    }
+
+    // std::sort is not constexpr before C++20.
+    static constexpr bool less(const StaticEntry* entries, std::size_t a, std::size_t b) {
+        return entries[a].key != entries[b].key ? entries[a].key < entries[b].key : a < b;
+    }
+
+    static constexpr void heapSort(const StaticEntry* entries, std::array<std::size_t, N>& order) {
+        for (std::size_t start = N / 2; start-- > 0;) {
+            siftDown(entries, order, start, N);
+        }
+        for (std::size_t end = N; end-- > 1;) {
+            std::size_t top = order[0];
+            order[0] = order[end];
+            order[end] = top;
+            siftDown(entries, order, 0, end);
+        }
+    }
+
+    static constexpr void siftDown(const StaticEntry* entries, std::array<std::size_t, N>& order, std::size_t root, std::size_t end) {
+        while (2 * root + 1 < end) {
+            std::size_t child = 2 * root + 1;
+            if (child + 1 < end && less(entries, order[child], order[child + 1])) {
+                ++child;
+            }
+            if (!less(entries, order[root], order[child])) {
+                return;
+            }
+            std::size_t swapped = order[root];
+            order[root] = order[child];
+            order[child] = swapped;
+            root = child;
+        }
+    }
+};
+
+template <std::size_t N>
+StaticDictionary(const StaticEntry (&)[N]) -> StaticDictionary<N>;
+
+template <std::size_t N>
+StaticDictionary(const std::array<StaticEntry, N>&) -> StaticDictionary<N>;
+
+#endif // STATIC_DICTIONARY_H
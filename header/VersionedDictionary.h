@@ -0,0 +1,116 @@
+#pragma once
+#ifndef VERSIONED_DICTIONARY_H
+#define VERSIONED_DICTIONARY_H
+
+#include <string>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+// Multi-version Dictionary with snapshot-isolated reads. Writers (serialised
+// by a mutex) never modify a published node: insert and remove copy the path
+// from the root and publish a new version. Readers open a Snapshot, which
+// pins the version current at that moment for consistent lookups and ordered
+// scans while writers carry on. Nodes replaced by a write are retired and
+// freed by epoch-based reclamation once no open snapshot can still see them.
+//
+// Snapshots must be closed before the dictionary is destroyed.
+class VersionedDictionary {
+    struct Node;
+    struct Version;
+
+public:
+    // A point-in-time view. Move-only; closing it (destruction) unpins its epoch.
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other);
+        Snapshot& operator=(Snapshot&& other);
+        ~Snapshot();
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        const std::string* lookup(int key) const; // Valid while the snapshot is open
+        void forEach(const std::function<void(int, const std::string&)>& visit) const; // In key order
+        std::size_t size() const;
+        std::uint64_t version() const;
+
+    private:
+        friend class VersionedDictionary;
+        Snapshot(const VersionedDictionary* owner, std::size_t slot, const Version* state);
+        void close();
+
+        const VersionedDictionary* owner;
+        std::size_t slot;
+        const Version* state;
+    };
+
+    struct GcStats {
+        std::uint64_t version;       // Number of the latest published version
+        std::size_t retiredNodes;    // Replaced nodes awaiting reclamation
+        std::size_t reclaimedNodes;  // Freed so far
+        std::size_t activeSnapshots;
+    };
+
+    VersionedDictionary();
+    ~VersionedDictionary();
+    VersionedDictionary(const VersionedDictionary&) = delete;
+    VersionedDictionary& operator=(const VersionedDictionary&) = delete;
+
+    void insert(int key, const std::string& item);
+    void remove(int key);
+    void removeIf(std::function<bool(int)> predicate);
+    bool lookup(int key, std::string& item) const; // Copies the latest item, if present
+    std::size_t size() const;
+
+    Snapshot snapshot() const; // Throws std::runtime_error if maxSnapshots are open
+    void reclaim();            // Free retired nodes no open snapshot can reach
+    GcStats gcStats() const;
+
+    static const std::size_t maxSnapshots = 128;
+
+private:
+    struct Node {
+        int key;
+        std::string item;
+        const Node* left;
+        const Node* right;
+
+        Node(int key, const std::string& item, const Node* left, const Node* right)
+            : key(key), item(item), left(left), right(right) {}
+    };
+
+    struct Version {
+        const Node* root;
+        std::size_t size;
+        std::uint64_t number;
+    };
+
+    std::atomic<const Version*> current;
+    std::atomic<std::size_t> latestSize; // Mirrors current->size; readable without pinning
+    mutable std::atomic<std::uint64_t> epoch;
+    mutable std::atomic<std::uint64_t> readerEpochs[maxSnapshots]; // 0 marks a free slot
+
+    mutable std::mutex writeMutex; // Serialises writers and guards the retire lists
+    std::vector<std::pair<std::uint64_t, const Node*>> retiredNodes;
+    std::vector<std::pair<std::uint64_t, const Version*>> retiredVersions;
+    std::size_t reclaimedCount;
+
+    std::size_t pin() const;
+    void unpin(std::size_t slot) const;
+    void publish(const Node* root, std::size_t size);
+    void retire(const Node* node);
+    void reclaimLocked();
+
+    const Node* insertWorker(const Node* node, int key, const std::string& item, bool& added);
+    const Node* removeWorker(const Node* node, int key, bool& removed);
+    const Node* removeMinWorker(const Node* node, const Node*& minNode);
+    static const Node* lookupWorker(const Node* node, int key);
+    static void forEachWorker(const Node* node, const std::function<void(int, const std::string&)>& visit);
+    static void deleteWorker(const Node* node);
+};
+
+#endif // VERSIONED_DICTIONARY_H
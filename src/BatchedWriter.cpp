@@ -0,0 +1,224 @@
+#include "BatchedWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+// Single-producer single-consumer linked queue (Vyukov): the producer only
+// touches 'tail', the applier only 'head', which is always a consumed stub.
+struct BatchedWriter::Queue {
+    struct Node {
+        Record record;
+        std::atomic<Node*> next;
+
+        explicit Node(Record&& record) : record(std::move(record)), next(nullptr) {}
+    };
+
+    Node* head;
+    Node* tail;
+
+    Queue() : head(new Node(Record())), tail(head) {}
+
+    ~Queue() {
+        while (head != nullptr) {
+            Node* next = head->next.load();
+            delete head;
+            head = next;
+        }
+    }
+
+    void push(Node* node) {
+        tail->next.store(node, std::memory_order_release);
+        tail = node;
+    }
+
+    bool pop(Record& record) {
+        Node* next = head->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+        record = std::move(next->record);
+        delete head;
+        head = next; // Becomes the new stub
+        return true;
+    }
+};
+
+BatchedWriter::BatchedWriter(Dictionary& target, std::mutex& targetLock)
+    : target(target), targetLock(targetLock), nextTicket(0), appliedTickets(0), stopping(false),
+      counters(BatchStats{ 0, 0, 0 }) {
+    applier = std::thread(&BatchedWriter::applyLoop, this);
+}
+
+BatchedWriter::~BatchedWriter() {
+    try {
+        flush();
+    }
+    catch (...) {
+        // A failed batch has already been reported to any waiter that asked.
+    }
+    stopping.store(true);
+    applier.join();
+}
+
+BatchedWriter::Producer& BatchedWriter::producer() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    queues.emplace_back(new Queue());
+    producers.emplace_back(new Producer(*this, *queues.back()));
+    return *producers.back();
+}
+
+BatchedWriter::Producer::Producer(BatchedWriter& owner, Queue& queue)
+    : owner(owner), queue(queue) {}
+
+std::uint64_t BatchedWriter::Producer::insert(int key, const std::string& item) {
+    return owner.submit(queue, key, false, item);
+}
+
+std::uint64_t BatchedWriter::Producer::remove(int key) {
+    return owner.submit(queue, key, true, std::string());
+}
+
+// Everything that can throw (copying the item, allocating the node) comes
+// before the ticket: a ticket taken but never queued would stall every drain.
+std::uint64_t BatchedWriter::submit(Queue& queue, int key, bool erase, const std::string& item) {
+    Queue::Node* node = new Queue::Node(Record{ 0, key, erase, item });
+    std::uint64_t ticket = nextTicket.fetch_add(1);
+    node->record.ticket = ticket;
+    queue.push(node);
+    return ticket;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Waiting
+
+void BatchedWriter::await(std::uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    batchApplied.wait(lock, [&] { return appliedTickets.load() > ticket; });
+    rethrowFailure();
+}
+
+void BatchedWriter::flush() {
+    std::uint64_t end = nextTicket.load();
+    std::unique_lock<std::mutex> lock(stateMutex);
+    batchApplied.wait(lock, [&] { return appliedTickets.load() >= end; });
+    rethrowFailure();
+}
+
+// Hand a stored applier failure to this waiter, once. Needs stateMutex.
+void BatchedWriter::rethrowFailure() {
+    if (failure != nullptr) {
+        std::exception_ptr error = failure;
+        failure = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+BatchedWriter::BatchStats BatchedWriter::stats() const {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return counters;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Applier
+
+void BatchedWriter::applyLoop() {
+    std::vector<Record> pending; // Drained early, belongs to a later batch
+    std::vector<Record> batch;
+    int idleRounds = 0;
+    for (;;) {
+        if (drainBatch(pending, batch)) {
+            applyRecords(batch);
+            idleRounds = 0;
+        }
+        else if (stopping.load()) {
+            return;
+        }
+        else if (++idleRounds < 64) {
+            std::this_thread::yield();
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+// Collect every write whose ticket is below the sequence value read on
+// entry. A producer takes its ticket just before pushing, so some of those
+// writes may still be in flight; the drain waits for them, which keeps the
+// applied tickets a contiguous prefix.
+bool BatchedWriter::drainBatch(std::vector<Record>& pending, std::vector<Record>& batch) {
+    std::uint64_t begin = appliedTickets.load();
+    std::uint64_t end = nextTicket.load();
+    if (end == begin) {
+        return false;
+    }
+
+    batch.clear();
+    std::vector<Record> later;
+    for (Record& record : pending) {
+        (record.ticket < end ? batch : later).push_back(std::move(record));
+    }
+    pending.swap(later);
+
+    // Queues registered after this point only hold tickets >= end.
+    std::vector<Queue*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        for (const std::unique_ptr<Queue>& queue : queues) {
+            snapshot.push_back(queue.get());
+        }
+    }
+
+    Record record;
+    while (batch.size() < end - begin) {
+        for (Queue* queue : snapshot) {
+            while (queue->pop(record)) {
+                (record.ticket < end ? batch : pending).push_back(std::move(record));
+            }
+        }
+        if (batch.size() < end - begin) {
+            std::this_thread::yield();
+        }
+    }
+    return true;
+}
+
+// Sort by key and ticket, keep the last write per key, apply in one pass.
+void BatchedWriter::applyRecords(std::vector<Record>& batch) {
+    std::sort(batch.begin(), batch.end(), [](const Record& a, const Record& b) {
+        return a.key != b.key ? a.key < b.key : a.ticket < b.ticket;
+    });
+
+    std::vector<Dictionary::BatchWrite> writes;
+    std::uint64_t end = 0;
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        end = std::max(end, batch[i].ticket + 1);
+        if (i + 1 < batch.size() && batch[i + 1].key == batch[i].key) {
+            continue; // Superseded by a later write to the same key
+        }
+        writes.push_back(Dictionary::BatchWrite{ batch[i].key, batch[i].erase, std::move(batch[i].item) });
+    }
+
+    // A failure must not end the applier thread, and the tickets must still
+    // advance or every waiter would hang; the next waiter rethrows it.
+    std::exception_ptr error;
+    try {
+        std::lock_guard<std::mutex> lock(targetLock);
+        target.applyBatch(writes);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    if (error != nullptr && failure == nullptr) {
+        failure = error;
+    }
+    ++counters.batches;
+    counters.writes += batch.size();
+    counters.collapsed += batch.size() - writes.size();
+    appliedTickets.store(end);
+    batchApplied.notify_all();
+}
@@ -0,0 +1,235 @@
+#include "CompactDictionary.h"
+#include <stdexcept>
+
+CompactDictionary::CompactDictionary() : root(none), count(0) {}
+
+// Links are indices, so the arena is copied as one block: vector copies
+// trivially copyable elements with memmove. Only the items need a deep copy,
+// and free slots hold empty strings.
+CompactDictionary::CompactDictionary(const CompactDictionary& other)
+    : nodes(other.nodes), items(other.items), freeSlots(other.freeSlots),
+      root(other.root), count(other.count) {}
+
+CompactDictionary& CompactDictionary::operator=(const CompactDictionary& other) {
+    if (this != &other) {
+        CompactDictionary copy(other); // Leaves this untouched if copying throws
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+CompactDictionary::CompactDictionary(CompactDictionary&& other)
+    : nodes(std::move(other.nodes)), items(std::move(other.items)), freeSlots(std::move(other.freeSlots)),
+      root(other.root), count(other.count) { // Transfer ownership of the arrays
+    other.nodes.clear();
+    other.items.clear();
+    other.freeSlots.clear();
+    other.root = none;
+    other.count = 0;
+}
+
+CompactDictionary& CompactDictionary::operator=(CompactDictionary&& other) {
+    if (this != &other) {
+        nodes = std::move(other.nodes);
+        items = std::move(other.items);
+        freeSlots = std::move(other.freeSlots);
+        root = other.root;
+        count = other.count;
+        other.nodes.clear();
+        other.items.clear();
+        other.freeSlots.clear();
+        other.root = none;
+        other.count = 0;
+    }
+    return *this;
+}
+
+void CompactDictionary::reserve(std::size_t entries) {
+    if (entries > maxEntries) {
+        throw std::length_error("CompactDictionary: more entries than 32-bit indices can address");
+    }
+    nodes.reserve(entries);
+}
+
+// Take a free slot, or append one, for a new node. The item is copied before
+// anything changes, and the arrays stay the same length if growing throws.
+std::uint32_t CompactDictionary::allocateSlot(int key, const std::string& item) {
+    std::string copy(item);
+    std::uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        items[slot].swap(copy);
+        freeSlots.pop_back();
+    }
+    else {
+        if (nodes.size() >= maxEntries) {
+            throw std::length_error("CompactDictionary: more entries than 32-bit indices can address");
+        }
+        slot = static_cast<std::uint32_t>(nodes.size());
+        items.push_back(std::move(copy));
+        try {
+            nodes.push_back(IndexNode());
+        }
+        catch (...) {
+            items.pop_back();
+            throw;
+        }
+    }
+    nodes[slot] = IndexNode{ key, none, none };
+    ++count;
+    return slot;
+}
+
+void CompactDictionary::releaseSlot(std::uint32_t slot) {
+    items[slot].clear();
+    items[slot].shrink_to_fit();
+    freeSlots.push_back(slot);
+    --count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Add a key-item pair, overwriting the item of an existing key.
+void CompactDictionary::insert(int key, const std::string& item) {
+    std::uint32_t parent = none;
+    std::uint32_t node = root;
+    while (node != none) {
+        if (key == nodes[node].key) {
+            items[node] = item; // Update the item if the key exists.
+            return;
+        }
+        parent = node;
+        node = key < nodes[node].key ? nodes[node].left : nodes[node].right;
+    }
+
+    // Link through the parent's index: allocating may move the node array.
+    std::uint32_t slot = allocateSlot(key, item);
+    if (parent == none) {
+        root = slot;
+    }
+    else if (key < nodes[parent].key) {
+        nodes[parent].left = slot;
+    }
+    else {
+        nodes[parent].right = slot;
+    }
+}
+
+std::size_t CompactDictionary::size() const {
+    return count;
+}
+
+// Only the index nodes are touched until the key is found.
+std::string* CompactDictionary::lookup(int key) {
+    std::uint32_t node = root;
+    while (node != none) {
+        const IndexNode& current = nodes[node];
+        if (key == current.key) {
+            return &items[node];
+        }
+        node = key < current.key ? current.left : current.right;
+    }
+    return nullptr;
+}
+
+// Remove a key. A node with two children is replaced by its in-order
+// successor's slot, so surviving entries keep their indices.
+void CompactDictionary::remove(int key) {
+    std::uint32_t* link = &root; // No allocation below, so links stay valid
+    while (*link != none && nodes[*link].key != key) {
+        link = key < nodes[*link].key ? &nodes[*link].left : &nodes[*link].right;
+    }
+    if (*link == none) {
+        return; // Key not found
+    }
+
+    std::uint32_t node = *link;
+    if (nodes[node].left != none && nodes[node].right != none) {
+        std::uint32_t successor = detachMin(nodes[node].right);
+        nodes[successor].left = nodes[node].left;
+        nodes[successor].right = nodes[node].right;
+        *link = successor;
+    }
+    else {
+        *link = nodes[node].left != none ? nodes[node].left : nodes[node].right;
+    }
+    releaseSlot(node);
+}
+
+std::uint32_t CompactDictionary::detachMin(std::uint32_t& link) {
+    std::uint32_t* current = &link;
+    while (nodes[*current].left != none) {
+        current = &nodes[*current].left;
+    }
+    std::uint32_t minNode = *current;
+    *current = nodes[minNode].right; // Its right subtree takes its place
+    return minNode;
+}
+
+void CompactDictionary::removeIf(std::function<bool(int)> predicate) {
+    removeIf([&](int key, const std::string&) { return predicate(key); });
+}
+
+void CompactDictionary::removeIf(std::function<bool(int, const std::string&)> predicate) {
+    std::vector<int> keysToRemove;
+    collectKeysToRemove(root, predicate, keysToRemove);
+    for (int key : keysToRemove) {
+        remove(key);
+    }
+}
+
+void CompactDictionary::collectKeysToRemove(std::uint32_t node, const std::function<bool(int, const std::string&)>& predicate, std::vector<int>& keysToRemove) {
+    if (node == none) {
+        return;
+    }
+    if (predicate(nodes[node].key, items[node])) {
+        keysToRemove.push_back(nodes[node].key);
+    }
+    collectKeysToRemove(nodes[node].left, predicate, keysToRemove);
+    collectKeysToRemove(nodes[node].right, predicate, keysToRemove);
+}
+
+CompactDictionary::MemoryStats CompactDictionary::memoryStats() const {
+    std::size_t itemBytes = items.size() * sizeof(std::string);
+    for (const std::string& item : items) {
+        itemBytes += item.size();
+    }
+    return MemoryStats{ nodes.capacity() * sizeof(IndexNode), itemBytes };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CompactDictionary::displayEntries() {
+    displayEntriesWorker(root);
+}
+
+void CompactDictionary::displayEntriesWorker(std::uint32_t node) {
+    if (node == none) return;
+
+    std::cout << "Key: " << nodes[node].key << ", Item: " << items[node] << std::endl;
+    displayEntriesWorker(nodes[node].left);
+    displayEntriesWorker(nodes[node].right);
+}
+
+void CompactDictionary::displayTree() {
+    displayTreeWorker(root, 0);
+}
+
+void CompactDictionary::displayTreeWorker(std::uint32_t node, int depth) {
+    if (node == none) {
+        printIndent(depth);
+        std::cout << "LEAF" << std::endl;
+        return;
+    }
+
+    displayTreeWorker(nodes[node].left, depth + 1);
+    printIndent(depth);
+    std::cout << "Key: " << nodes[node].key << ", Item: " << items[node] << std::endl;
+    displayTreeWorker(nodes[node].right, depth + 1);
+}
+
+void CompactDictionary::printIndent(int depth) {
+    for (int i = 0; i < depth; ++i) {
+        std::cout << "  "; // Two spaces for each level of depth
+    }
+}
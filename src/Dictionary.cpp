@@ -1,6 +1,20 @@
 #include "Dictionary.h"
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
 
-Dictionary::Dictionary() : root(nullptr) {}
+Dictionary::Dictionary()
+    : root(nullptr), count(0), byteCount(0), cacheHitCount(0), cacheMissCount(0),
+      maxEntries(0), maxBytes(0), lruHead(nullptr), lruTail(nullptr),
+      evictionCount(0), expirationCount(0), lastInserted(nullptr), shapeVersion(0), lastHashDelta(0),
+      deferredPath(nullptr) {}
 
 /**void Dictionary::insert(int key, const std::string& item) {
     // Create a new node
@@ -66,43 +80,291 @@ Dictionary::Dictionary() : root(nullptr) {}
 
 // Add a key-item pair to the dictionary.
 void Dictionary::insert(int key, const std::string& item) {
-    root = insertWorker(root, key, item);
+    insertEntry(&root, key, item, Clock::time_point::max());
+}
+
+// Add a key-item pair that expires once 'ttl' has passed.
+void Dictionary::insert(int key, const std::string& item, Clock::duration ttl) {
+    insertEntry(&root, key, item, Clock::now() + ttl);
+}
+
+// Insert below 'link', which must be the root link or a link whose subtree
+// covers the key's range, then do the bookkeeping every insert needs. Below
+// any other link, 'path' holds the links from the root down to it, and the
+// hash updates above the link are left pending on it.
+void Dictionary::insertEntry(Node** link, int key, const std::string& item, Clock::time_point expiresAt,
+    std::vector<PathLink>* path) {
+    if (deferredPath != path) {
+        settleHashes();
+    }
+    *link = insertWorker(*link, key, item);
+    if (path != nullptr) {
+        deferAlongPath(*path, lastHashDelta);
+        deferredPath = path;
+    }
+    Node* node = lastInserted;
+
+    // Re-index the entry if its expiry changed.
+    if (node->expiresAt != expiresAt) {
+        if (node->expiresAt != Clock::time_point::max()) {
+            expiryIndex.erase(std::make_pair(node->expiresAt, key));
+        }
+        node->expiresAt = expiresAt;
+        if (expiresAt != Clock::time_point::max()) {
+            expiryIndex.insert(std::make_pair(expiresAt, key));
+        }
+    }
+
+    if (isBounded()) {
+        unlinkLru(node);
+        pushLruFront(node);
+        enforceBounds(node);
+    }
+    else if (!expiryIndex.empty()) {
+        removeExpired();
+    }
+
+    growFilterIfNeeded();
+}
+
+// Grow the filter before its false-positive rate degrades too far.
+void Dictionary::growFilterIfNeeded() {
+    if (!filter.counters.empty() && count > 2 * filter.capacity) {
+        filter.configure(2 * count, filter.targetRate);
+        ++filter.rebuilds;
+        addToFilterWorker(root);
+    }
+}
+
+// Apply writes sorted by strictly ascending key, each found by resuming
+// from the path to the previous one.
+void Dictionary::applyBatch(const std::vector<BatchWrite>& writes) {
+    // Evictions and expiries restructure the tree mid-batch, which would
+    // leave the saved path dangling, so bounded dictionaries go key by key.
+    if (isBounded() || !expiryIndex.empty()) {
+        for (const BatchWrite& write : writes) {
+            if (write.erase) {
+                remove(write.key);
+            }
+            else {
+                insert(write.key, write.item);
+            }
+        }
+        return;
+    }
+
+    settleHashes();
+    std::vector<PathLink> path;
+    path.push_back(PathLink{ &root, static_cast<long long>(INT_MIN) - 1, static_cast<long long>(INT_MAX) + 1, 0 });
+    deferredPath = &path;
+
+    try {
+        for (const BatchWrite& write : writes) {
+            Node** link = seekPath(path, write.key);
+
+            // Removal only rewrites this link and the removed node's subtree,
+            // which lies below every saved link, so the path stays valid.
+            if (write.erase) {
+                *link = removeWorker(*link, write.key);
+            }
+            else {
+                *link = insertWorker(*link, write.key, write.item);
+                growFilterIfNeeded();
+            }
+            deferAlongPath(path, lastHashDelta);
+        }
+    }
+    catch (...) {
+        settleHashes();
+        throw;
+    }
+    settleHashes();
+}
+
+// Pop the path back to the deepest link whose range holds 'key', then
+// descend from there, recording each link taken. Returns the link that
+// holds the key, or the empty link where it belongs. The root link at the
+// bottom of the path covers every key and is never popped. Pending hash
+// deltas move up as links are popped, and off the deepest remaining link,
+// so every node at or below the returned link has its true sum.
+Dictionary::Node** Dictionary::seekPath(std::vector<PathLink>& path, int key) {
+    while (key <= path.back().lower || key >= path.back().upper) {
+        settleLink(path, path.size() - 1);
+        path.pop_back();
+    }
+    settleLink(path, path.size() - 1);
+    Node** link = path.back().link;
+    while (*link != nullptr && (*link)->key != key) {
+        Node* node = *link;
+        PathLink parent = path.back();
+        if (key < node->key) {
+            link = &node->left;
+            path.push_back(PathLink{ link, parent.lower, node->key, 0 });
+        }
+        else {
+            link = &node->right;
+            path.push_back(PathLink{ link, node->key, parent.upper, 0 });
+        }
+    }
+    return link;
+}
+
+Dictionary::InsertCursor::InsertCursor(Dictionary& dict)
+    : dict(dict), version(dict.shapeVersion) {
+    path.push_back(PathLink{ &dict.root, static_cast<long long>(INT_MIN) - 1, static_cast<long long>(INT_MAX) + 1, 0 });
+}
+
+Dictionary::InsertCursor::~InsertCursor() {
+    if (dict.deferredPath == &path) {
+        dict.settleHashes();
+    }
+}
+
+// Adding a leaf leaves every saved link and range valid; only a change of
+// shape since the last write, or one caused by this write's evictions and
+// expiries, discards the path. Whatever changes the shape settles the
+// pending hashes first, so none are lost with it.
+void Dictionary::InsertCursor::insert(int key, const std::string& item) {
+    if (version != dict.shapeVersion) {
+        path.resize(1);
+    }
+    Node** link = seekPath(path, key);
+    version = dict.shapeVersion;
+    dict.insertEntry(link, key, item, Clock::time_point::max(), &path);
+    if (version != dict.shapeVersion) {
+        path.resize(1);
+        version = dict.shapeVersion;
+    }
+}
+
+std::size_t Dictionary::size() const {
+    return count;
 }
 
 // Recursive worker for insert
 Dictionary::Node* Dictionary::insertWorker(Node* node, int key, const std::string& item) {
     if (node == nullptr) {
-        return new Node(key, item);
+        lastInserted = new Node(key, item);
+        lastInserted->subtreeHash = entryHash(key, item);
+        lastHashDelta = lastInserted->subtreeHash;
+        ++count;
+        byteCount += entryBytes(lastInserted);
+        if (!filter.counters.empty()) {
+            filter.add(key);
+        }
+        if (!hashIndex.slots.empty()) {
+            hashIndex.insert(lastInserted);
+        }
+        if (itemIndex.enabled) {
+            itemIndex.add(item, key);
+        }
+        return lastInserted;
     }
 
     //Find correct position and insert node recursively
     if (key < node->key) {
         node->left = insertWorker(node->left, key, item);//Insert in left subtree.
+        node->subtreeHash += lastHashDelta;
+        return node;
     }
     else if (key > node->key) {
         node->right = insertWorker(node->right, key, item);//Insert in right subtree.
+        node->subtreeHash += lastHashDelta;
+        return node;
+    }
+
+    std::uint64_t before = ownHash(node);
+    if (itemIndex.enabled && node->item != item) {
+        // Copy and index the new item before changing anything, so a failed
+        // allocation leaves the entry and the index as they were.
+        std::string replacement(item);
+        itemIndex.add(item, key);
+        itemIndex.remove(node->item, key);
+        byteCount -= entryBytes(node);
+        node->item.swap(replacement);
+        byteCount += entryBytes(node);
     }
     else {
         // Update the item if the key exists.
+        byteCount -= entryBytes(node);
         node->item = item;
+        byteCount += entryBytes(node);
     }
+    lastHashDelta = entryHash(key, item) - before;
+    node->subtreeHash += lastHashDelta;
+    lastInserted = node;
     return node;
 }
 
 // Method to lookup an item by its key.
 std::string* Dictionary::lookup(int key) {
-    return lookupWorker(root, key);// Begin at the root for the lookup.
+    // Begin at the root for the lookup, unless the hash index or the cache
+    // already knows the node.
+    Node* node;
+    if (!hashIndex.slots.empty()) {
+        node = hashIndex.find(key);
+    }
+    else {
+        node = lookupCache.empty() ? filteredLookup(key) : cachedLookup(key);
+    }
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    if (node->expiresAt != Clock::time_point::max() && node->expiresAt <= Clock::now()) {
+        remove(key); // Lazily drop an entry whose TTL has passed
+        ++expirationCount;
+        return nullptr;
+    }
+    if (isBounded()) {
+        unlinkLru(node); // Mark as most recently used
+        pushLruFront(node);
+    }
+    return &(node->item);
+}
+
+// Consult the hot-key cache before descending the tree.
+Dictionary::Node* Dictionary::cachedLookup(int key) {
+    CacheSlot& slot = lookupCache[cacheSlotFor(key)];
+    if (slot.node != nullptr && slot.key == key) {
+        ++cacheHitCount;
+        return slot.node;
+    }
+    ++cacheMissCount;
+
+    Node* node = filteredLookup(key);
+    if (node != nullptr) {
+        slot.key = key; // Remember the node, evicting whatever shared the slot.
+        slot.node = node;
+    }
+    return node;
+}
+
+// Descend the tree unless the membership filter proves the key is absent.
+Dictionary::Node* Dictionary::filteredLookup(int key) {
+    if (filter.counters.empty()) {
+        return lookupWorker(root, key);
+    }
+    if (!filter.mayContain(key)) {
+        ++filter.negatives;
+        return nullptr;
+    }
+    Node* node = lookupWorker(root, key);
+    if (node == nullptr) {
+        ++filter.falsePositives;
+    }
+    return node;
 }
 
 // Recursive worker for lookup
-std::string* Dictionary::lookupWorker(Node* currentNode, int key) {
+Dictionary::Node* Dictionary::lookupWorker(Node* currentNode, int key) {
     if (currentNode == nullptr) {
         return nullptr; // Key not found
     }
 
     // Search for the key in the tree recursively.
     if (key == currentNode->key) {
-        return &(currentNode->item); // Key found
+        return currentNode; // Key found
     }
     else if (key < currentNode->key) {
         return lookupWorker(currentNode->left, key); // Search in the left subtree
@@ -147,6 +409,19 @@ void Dictionary::displayTreeWorker(Node* node, int depth) {
     displayTreeWorker(node->right, depth + 1); // Traverse right subtree
 }
 
+// Visit every entry in ascending key order.
+void Dictionary::forEach(const std::function<void(int, const std::string&)>& visit) const {
+    forEachWorker(root, visit);
+}
+
+void Dictionary::forEachWorker(const Node* node, const std::function<void(int, const std::string&)>& visit) {
+    if (node != nullptr) {
+        forEachWorker(node->left, visit);
+        visit(node->key, node->item);
+        forEachWorker(node->right, visit);
+    }
+}
+
 // Method to print indentation based on node depth.
 void Dictionary::printIndent(int depth) {
     for (int i = 0; i < depth; ++i) {
@@ -156,45 +431,83 @@ void Dictionary::printIndent(int depth) {
 
 // Function to delete a key-item pair from a dictionary.
 void Dictionary::remove(int key) {
+    settleHashes();
     root = removeWorker(root, key);
 }
 
 // Recursive worker for remove
 Dictionary::Node* Dictionary::removeWorker(Node* node, int key) {
     if (node == nullptr) {
+        lastHashDelta = 0;
         return nullptr; // Key not found
     }
 
     if (key < node->key) {
         node->left = removeWorker(node->left, key);
+        node->subtreeHash += lastHashDelta;
     }
     else if (key > node->key) {
         node->right = removeWorker(node->right, key);
+        node->subtreeHash += lastHashDelta;
     }
     else {
-        // Node with two children
+        Node* replacement;
+        std::uint64_t removed = ownHash(node);
+        // Node with two children: splice the in-order successor into its place,
+        // so surviving entries keep their nodes (cached Node* stay valid).
         if (node->left != nullptr && node->right != nullptr) {
-            Node* successor = findAndDetachMinNode(node->right);
-            node->key = successor->key;
-            node->item = successor->item;
-            node->right = removeWorker(node->right, successor->key);
+            replacement = findAndDetachMinNode(node->right);
+            replacement->left = node->left;
+            replacement->right = node->right;
+            replacement->subtreeHash = node->subtreeHash - removed;
         }
         else {
             // Node with one or no child
-            Node* temp = (node->left != nullptr) ? node->left : node->right;
-            delete node;
-            return temp;
+            replacement = (node->left != nullptr) ? node->left : node->right;
         }
+        lastHashDelta = 0 - removed;
+        deleteEntry(node);
+        return replacement;
     }
     return node;
 }
 
-Dictionary::Node* Dictionary::findAndDetachMinNode(Node* node) {
+// Drop an unlinked node's traces from the cache, filter, indexes and counts,
+// then free it.
+void Dictionary::deleteEntry(Node* node) {
+    invalidateCachedKey(node->key);
+    if (!filter.counters.empty()) {
+        filter.remove(node->key);
+    }
+    if (!hashIndex.slots.empty()) {
+        hashIndex.erase(node->key);
+    }
+    if (itemIndex.enabled) {
+        itemIndex.remove(node->item, node->key);
+    }
+    if (isBounded()) {
+        unlinkLru(node);
+    }
+    if (node->expiresAt != Clock::time_point::max()) {
+        expiryIndex.erase(std::make_pair(node->expiresAt, node->key));
+    }
+    --count;
+    byteCount -= entryBytes(node);
+    ++shapeVersion;
+    freeNode(node);
+}
+
+// Unlink the minimum node of a non-empty subtree and return it.
+Dictionary::Node* Dictionary::findAndDetachMinNode(Node*& node) {
     if (node->left == nullptr) {
-        return node;
+        Node* minNode = node;
+        node = node->right; // Its right subtree takes its place
+        return minNode;
     }
     else {
-        return findAndDetachMinNode(node->left);
+        Node* minNode = findAndDetachMinNode(node->left);
+        node->subtreeHash -= ownHash(minNode); // Its right link is not yet rewritten
+        return minNode;
     }
 }
 
@@ -206,14 +519,23 @@ void Dictionary::deepDeleteWorker(Node* node) {
     if (node != nullptr) {
         deepDeleteWorker(node->left);  // Delete left subtree
         deepDeleteWorker(node->right); // Delete right subtree
-        delete node;              // Delete the current node
+        freeNode(node);           // Delete the current node
     }
 }
 
 
 Dictionary::Dictionary(const Dictionary& other)
+    : count(other.count), byteCount(other.byteCount), cacheHitCount(0), cacheMissCount(0),
+      filter(other.filter), lruHead(nullptr), lruTail(nullptr), lastInserted(nullptr), shapeVersion(0),
+      lastHashDelta(0), deferredPath(nullptr), itemIndex(other.itemIndex)
 {
+    other.settleHashes();
+    if (!other.hashIndex.slots.empty()) {
+        hashIndex.reset(other.count); // copyTree indexes the new nodes
+    }
     root = copyTree(other.root);
+    copyBoundedState(other);
+    lookupCache.assign(other.lookupCache.size(), CacheSlot{ 0, nullptr }); // Same size, cold slots
 }
 
 Dictionary::Node* Dictionary::copyTree(Node* node) {
@@ -222,36 +544,50 @@ Dictionary::Node* Dictionary::copyTree(Node* node) {
     }
 
     Node* newNode = new Node(node->key, node->item);
+    newNode->expiresAt = node->expiresAt;
+    newNode->subtreeHash = node->subtreeHash;
+    if (!hashIndex.slots.empty()) {
+        hashIndex.insert(newNode);
+    }
     newNode->left = copyTree(node->left);
     newNode->right = copyTree(node->right);
     return newNode;
 }
 
 Dictionary::Node* Dictionary::rotateRight(Node* a) {
+    ++shapeVersion;
     Node* b = a->left;
     Node* beta = b->right;
 
-    // Perform rotation
+    // Perform rotation; b's subtree now holds what a's did
     b->right = a;
     a->left = beta;
+    std::uint64_t total = a->subtreeHash;
+    a->subtreeHash = total - b->subtreeHash + subtreeHashOf(beta);
+    b->subtreeHash = total;
 
     // Return new root of this subtree
     return b;
 }
 
 Dictionary::Node* Dictionary::rotateLeft(Node* a) {
+    ++shapeVersion;
     Node* b = a->right;
     Node* beta = b->left;
 
-    // Perform rotation
+    // Perform rotation; b's subtree now holds what a's did
     b->left = a;
     a->right = beta;
+    std::uint64_t total = a->subtreeHash;
+    a->subtreeHash = total - b->subtreeHash + subtreeHashOf(beta);
+    b->subtreeHash = total;
 
     // Return new root of this subtree
     return b;
 }
 
 void Dictionary::testRotations() {
+    settleHashes();
     root = rotateRight(root); // Rotate right at root
     root = rotateLeft(root);  // Then rotate left at root
 
@@ -259,36 +595,104 @@ void Dictionary::testRotations() {
 }
 
 Dictionary::Dictionary(Dictionary&& other)
-    : root(other.root) { // Transfer ownership of the internal tree
+    : root(other.root), // Transfer ownership of the internal tree
+      count(other.count), byteCount(other.byteCount),
+      lookupCache(std::move(other.lookupCache)), // Cached nodes move with the tree
+      cacheHitCount(other.cacheHitCount),
+      cacheMissCount(other.cacheMissCount),
+      filter(std::move(other.filter)),
+      maxEntries(other.maxEntries), maxBytes(other.maxBytes),
+      lruHead(other.lruHead), lruTail(other.lruTail), // The recency list moves with its nodes
+      expiryIndex(std::move(other.expiryIndex)),
+      evictionCount(other.evictionCount), expirationCount(other.expirationCount),
+      lastInserted(nullptr), shapeVersion(0), lastHashDelta(0), deferredPath(nullptr),
+      hashIndex(std::move(other.hashIndex)),
+      itemIndex(std::move(other.itemIndex)),
+      slabs(std::move(other.slabs)) { // Compacted nodes keep their block
+    other.settleHashes(); // Its cursor's path still reaches the nodes through other.root
     other.root = nullptr; // Leave the source object in a valid state
+    ++other.shapeVersion;
+    other.slabs.clear();
+    other.compaction = CompactionState();
+    other.count = 0;
+    other.byteCount = 0;
+    other.resetBoundedState();
+    other.lookupCache.clear();
+    other.filter = CountingBloomFilter();
+    other.hashIndex = NodeHashIndex();
+    other.itemIndex = ItemIndex();
 }
 
 Dictionary& Dictionary::operator=(const Dictionary& other) {
     if (this != &other) { // Check for self-assignment
+        settleHashes(); // Cursors on this tree hold no pending deltas once it is gone
+        other.settleHashes();
         deepDeleteWorker(root); // Deallocate current tree
+        ++shapeVersion;
+        compaction = CompactionState();
+        hashIndex = NodeHashIndex();
+        if (!other.hashIndex.slots.empty()) {
+            hashIndex.reset(other.count);
+        }
         root = copyTree(other.root); // Deep copy the tree from 'other'
+        count = other.count;
+        byteCount = other.byteCount;
+        clearLookupCache();
+        filter = other.filter;
+        itemIndex = other.itemIndex;
+        copyBoundedState(other);
     }
     return *this; // Return a reference to the current object
 }
 
 Dictionary& Dictionary::operator=(Dictionary&& other) {
     if (this != &other) { // Check for self-assignment
+        settleHashes();
+        other.settleHashes();
         deepDeleteWorker(root); // Deallocate current tree
 
         // Transfer ownership of resources
         root = other.root;
         other.root = nullptr; // Set the source object's pointer to nullptr
+        ++shapeVersion;
+        ++other.shapeVersion;
+        count = other.count;
+        other.count = 0;
+        clearLookupCache();
+        other.clearLookupCache(); // Its cached nodes now belong to this tree
+        filter = std::move(other.filter);
+        other.filter = CountingBloomFilter();
+
+        byteCount = other.byteCount;
+        maxEntries = other.maxEntries;
+        maxBytes = other.maxBytes;
+        lruHead = other.lruHead;
+        lruTail = other.lruTail;
+        expiryIndex = std::move(other.expiryIndex);
+        evictionCount = other.evictionCount;
+        expirationCount = other.expirationCount;
+        other.byteCount = 0;
+        other.resetBoundedState();
+
+        hashIndex = std::move(other.hashIndex);
+        other.hashIndex = NodeHashIndex();
+        itemIndex = std::move(other.itemIndex);
+        other.itemIndex = ItemIndex();
+        slabs = std::move(other.slabs); // Ours were released with our nodes
+        other.slabs.clear();
+        compaction = CompactionState();
+        other.compaction = CompactionState();
     }
     return *this; // Return a reference to the current object
 }
 
-void Dictionary::collectKeysToRemove(Node* node, std::function<bool(int)> predicate, std::vector<int>& keysToRemove) {
+void Dictionary::collectKeysToRemove(Node* node, const std::function<bool(int, const std::string&)>& predicate, std::vector<int>& keysToRemove) {
     if (node == nullptr) {
         return;
     }
 
     // Check the predicate for the current node
-    if (predicate(node->key)) {
+    if (predicate(node->key, node->item)) {
         keysToRemove.push_back(node->key);
     }
 
@@ -298,6 +702,10 @@ void Dictionary::collectKeysToRemove(Node* node, std::function<bool(int)> predic
 }
 
 void Dictionary::removeIf(std::function<bool(int)> predicate) {
+    removeIf([&](int key, const std::string&) { return predicate(key); });
+}
+
+void Dictionary::removeIf(std::function<bool(int, const std::string&)> predicate) {
     std::vector<int> keysToRemove;
     collectKeysToRemove(root, predicate, keysToRemove);
 
@@ -305,4 +713,1276 @@ void Dictionary::removeIf(std::function<bool(int)> predicate) {
     for (int key : keysToRemove) {
         remove(key); 
     }
-}
\ No newline at end of file
+}
+
+// Threads shared by every removeIfParallel call, started on first use and
+// grown to the largest count asked for. One call runs at a time; a call made
+// from inside a running task, such as a predicate, runs on its own thread.
+struct Dictionary::WorkerPool {
+    std::mutex callMutex; // Held for a whole run
+    std::mutex mutex;     // Guards the fields below
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::vector<std::thread> workers;
+    const std::function<void()>* task;
+    unsigned unclaimed; // Helper slots of the current run not yet taken
+    unsigned running;   // Helper slots of the current run not yet finished
+    std::exception_ptr error; // First exception thrown by a helper
+    bool stopping;
+
+    static thread_local bool inTask;
+
+    WorkerPool() : task(nullptr), unclaimed(0), running(0), stopping(false) {}
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Run 'work' on the calling thread and 'helpers' pool threads, returning
+    // once all have left it. The first exception, the caller's before any
+    // helper's, is rethrown then.
+    void run(unsigned helpers, const std::function<void()>& work) {
+        if (inTask) {
+            work();
+            return;
+        }
+        std::lock_guard<std::mutex> call(callMutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (workers.size() < helpers) {
+                workers.emplace_back(&WorkerPool::loop, this); // A failure here has run nothing
+            }
+            task = &work;
+            unclaimed = running = helpers;
+            error = nullptr;
+        }
+        wake.notify_all();
+
+        std::exception_ptr failure;
+        inTask = true;
+        try {
+            work();
+        }
+        catch (...) {
+            failure = std::current_exception();
+        }
+        inTask = false;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return running == 0; });
+        task = nullptr;
+        if (failure == nullptr) {
+            failure = error;
+        }
+        error = nullptr;
+        if (failure != nullptr) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    void loop() {
+        inTask = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [this] { return stopping || unclaimed > 0; });
+            if (stopping) {
+                return;
+            }
+            --unclaimed;
+            const std::function<void()>& work = *task;
+            lock.unlock();
+            std::exception_ptr failure;
+            try {
+                work();
+            }
+            catch (...) {
+                failure = std::current_exception();
+            }
+            lock.lock();
+            if (failure != nullptr && error == nullptr) {
+                error = failure;
+            }
+            if (--running == 0) {
+                finished.notify_all();
+            }
+        }
+    }
+};
+
+thread_local bool Dictionary::WorkerPool::inTask = false;
+
+Dictionary::WorkerPool& Dictionary::workerPool() {
+    static WorkerPool pool;
+    return pool;
+}
+
+// The tree is cut into parts: single nodes near the root and whole subtrees
+// below a cut depth, listed in key order. Pool threads claim parts and sort
+// their nodes into survivors and matches; the survivors are then
+// concatenated and relinked, and the matches deleted.
+void Dictionary::removeIfParallel(std::function<bool(int, const std::string&)> predicate, unsigned threads) {
+    settleHashes();
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    struct Part {
+        Node* node;
+        bool subtree; // Otherwise just the node itself
+        std::vector<Node*> survivors;
+        std::vector<Node*> matches;
+    };
+    std::vector<Part> parts;
+
+    // About 64 subtrees per thread on a balanced tree, for load balancing.
+    int cutDepth = 6;
+    for (unsigned n = threads; n > 1; n >>= 1) {
+        ++cutDepth;
+    }
+    std::function<void(Node*, int)> cut = [&](Node* node, int depth) {
+        if (node == nullptr) {
+            return;
+        }
+        if (depth == cutDepth) {
+            parts.push_back(Part{ node, true, {}, {} });
+            return;
+        }
+        cut(node->left, depth + 1);
+        parts.push_back(Part{ node, false, {}, {} });
+        cut(node->right, depth + 1);
+    };
+    cut(root, 0);
+
+    std::atomic<std::size_t> nextPart(0);
+    std::function<void()> work = [&] {
+        std::vector<Node*> stack;
+        try {
+            for (std::size_t i = nextPart++; i < parts.size(); i = nextPart++) {
+                Part& part = parts[i];
+                if (!part.subtree) {
+                    (predicate(part.node->key, part.node->item) ? part.matches : part.survivors).push_back(part.node);
+                    continue;
+                }
+                // Iterative in-order walk, so survivors come out sorted.
+                Node* node = part.node;
+                while (node != nullptr || !stack.empty()) {
+                    while (node != nullptr) {
+                        stack.push_back(node);
+                        node = node->left;
+                    }
+                    node = stack.back();
+                    stack.pop_back();
+                    (predicate(node->key, node->item) ? part.matches : part.survivors).push_back(node);
+                    node = node->right;
+                }
+            }
+        }
+        catch (...) {
+            nextPart = parts.size(); // No thread claims another part
+            throw;
+        }
+    };
+    workerPool().run(threads - 1, work); // Nothing is unlinked until every part is sorted
+
+    std::size_t matched = 0;
+    for (const Part& part : parts) {
+        matched += part.matches.size();
+    }
+    if (matched == 0) {
+        return; // Leave the shape alone
+    }
+
+    std::vector<Node*> survivors;
+    survivors.reserve(count - matched);
+    for (const Part& part : parts) {
+        survivors.insert(survivors.end(), part.survivors.begin(), part.survivors.end());
+    }
+    root = buildBalanced(survivors, 0, survivors.size());
+    for (const Part& part : parts) {
+        for (Node* node : part.matches) {
+            deleteEntry(node);
+        }
+    }
+}
+
+// Link nodes[begin, end), sorted by key, into a balanced subtree.
+Dictionary::Node* Dictionary::buildBalanced(const std::vector<Node*>& nodes, std::size_t begin, std::size_t end) {
+    if (begin == end) {
+        return nullptr;
+    }
+    std::size_t middle = begin + (end - begin) / 2;
+    Node* node = nodes[middle];
+    node->left = buildBalanced(nodes, begin, middle);
+    node->right = buildBalanced(nodes, middle + 1, end);
+    node->subtreeHash = entryHash(node->key, node->item) + subtreeHashOf(node->left) + subtreeHashOf(node->right);
+    return node;
+}
+
+void Dictionary::compact() {
+    compactFor(Clock::duration::max());
+}
+
+// Run compaction steps until none are left or 'budget' has passed, looking
+// at the clock every 64 steps.
+bool Dictionary::compactFor(Clock::duration budget) {
+    typedef CompactionState::Phase Phase;
+    settleHashes();
+    if (compaction.phase != Phase::Idle && (compaction.version != shapeVersion || compaction.count != count)) {
+        compaction = CompactionState(); // Changed since the last slice: start over
+    }
+    if (compaction.phase == Phase::Idle) {
+        compaction.phase = Phase::Vine;
+        compaction.link = &root;
+    }
+
+    Clock::time_point start = Clock::now();
+    for (std::size_t steps = 1; compactStep(); ++steps) {
+        if (steps % 64 == 0 && Clock::now() - start >= budget) {
+            compaction.version = shapeVersion;
+            compaction.count = count;
+            return false;
+        }
+    }
+    compaction = CompactionState();
+    return true;
+}
+
+// One rotation or one relocation; false once compaction is complete. Every
+// intermediate shape is a valid search tree.
+bool Dictionary::compactStep() {
+    typedef CompactionState::Phase Phase;
+    CompactionState& state = compaction;
+
+    // Tree to vine: rotate left children up until every node hangs off the
+    // right of the one before.
+    if (state.phase == Phase::Vine) {
+        if (*state.link != nullptr) {
+            if ((*state.link)->left != nullptr) {
+                *state.link = rotateRight(*state.link);
+            }
+            else {
+                state.link = &(*state.link)->right;
+            }
+            return true;
+        }
+        std::size_t complete = 0; // Largest 2^k - 1 not above the count
+        while (2 * complete + 1 <= count) {
+            complete = 2 * complete + 1;
+        }
+        state.phase = Phase::Compress;
+        state.link = &root;
+        state.rotations = count - complete;
+        state.nextPass = complete;
+        return true;
+    }
+
+    // Vine to tree: the first pass folds the nodes beyond a complete tree
+    // into its bottom level, and each later pass halves the remaining vine by
+    // rotating every other node down to the left.
+    if (state.phase == Phase::Compress) {
+        if (state.rotations > 0) {
+            *state.link = rotateLeft(*state.link);
+            state.link = &(*state.link)->right;
+            --state.rotations;
+            return true;
+        }
+        if (state.nextPass > 1) {
+            state.nextPass /= 2;
+            state.rotations = state.nextPass;
+            state.link = &root;
+            return true;
+        }
+        state.phase = Phase::Relocate;
+        state.link = &root;
+        if (count == 0) {
+            return false;
+        }
+        slabs.push_back(NodeSlab{ static_cast<Node*>(::operator new(count * sizeof(Node))), count, 0, 0 });
+    }
+
+    // In-order walk over links, moving each node once its left subtree has
+    // moved. A node is reached through its parent's current link: in the
+    // moved parent for a right child, in the parent still waiting on the
+    // stack for a left one.
+    if (state.phase == Phase::Relocate) {
+        while (*state.link != nullptr) {
+            state.pending.push_back(state.link);
+            state.link = &(*state.link)->left;
+        }
+        if (state.pending.empty()) {
+            return false;
+        }
+        Node** link = state.pending.back();
+        state.pending.pop_back();
+        *link = relocate(*link);
+        state.link = &(*link)->right;
+        return true;
+    }
+    return false;
+}
+
+// Move a node's entry into the next slot of the newest slab and repoint the
+// cache, hash index and recency list; the caller repoints the parent link.
+Dictionary::Node* Dictionary::relocate(Node* node) {
+    NodeSlab& slab = slabs.back();
+    Node* moved = new (slab.nodes + slab.used) Node(node->key, std::string());
+    ++slab.used;
+    ++slab.live;
+    moved->item.swap(node->item);
+    moved->left = node->left;
+    moved->right = node->right;
+    moved->expiresAt = node->expiresAt;
+    moved->subtreeHash = node->subtreeHash;
+    if (isBounded()) {
+        moved->lruPrev = node->lruPrev;
+        moved->lruNext = node->lruNext;
+        (moved->lruPrev != nullptr ? moved->lruPrev->lruNext : lruHead) = moved;
+        (moved->lruNext != nullptr ? moved->lruNext->lruPrev : lruTail) = moved;
+    }
+    invalidateCachedKey(node->key);
+    if (!hashIndex.slots.empty()) {
+        hashIndex.erase(node->key);
+        hashIndex.insert(moved);
+    }
+    if (lastInserted == node) {
+        lastInserted = moved;
+    }
+    ++shapeVersion;
+    freeNode(node);
+    return moved;
+}
+
+// Free an unlinked node. Slab nodes are destroyed in place and the slab goes
+// with its last node; the rest were allocated one by one.
+void Dictionary::freeNode(Node* node) {
+    for (std::size_t i = 0; i < slabs.size(); ++i) {
+        NodeSlab& slab = slabs[i];
+        if (!std::less<Node*>()(node, slab.nodes) && std::less<Node*>()(node, slab.nodes + slab.used)) {
+            node->~Node();
+            if (--slab.live == 0) {
+                ::operator delete(slab.nodes);
+                slabs.erase(slabs.begin() + i);
+            }
+            return;
+        }
+    }
+    delete node;
+}
+
+// Enable the hot-key cache with at least 'slots' direct-mapped entries.
+void Dictionary::enableLookupCache(std::size_t slots) {
+    std::size_t size = 1;
+    while (size < slots) {
+        size <<= 1;
+    }
+    lookupCache.assign(size, CacheSlot{ 0, nullptr });
+    cacheHitCount = 0;
+    cacheMissCount = 0;
+}
+
+void Dictionary::disableLookupCache() {
+    lookupCache.clear();
+    lookupCache.shrink_to_fit();
+}
+
+Dictionary::CacheStats Dictionary::cacheStats() const {
+    return CacheStats{ cacheHitCount, cacheMissCount };
+}
+
+// Fibonacci hashing spreads nearby keys across the power-of-two table.
+std::size_t Dictionary::cacheSlotFor(int key) const {
+    unsigned long long h = static_cast<unsigned int>(key) * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(h >> 32) & (lookupCache.size() - 1);
+}
+
+// Drop the cached node for a key that is about to be deleted.
+void Dictionary::invalidateCachedKey(int key) {
+    if (lookupCache.empty()) {
+        return;
+    }
+    CacheSlot& slot = lookupCache[cacheSlotFor(key)];
+    if (slot.key == key) {
+        slot.node = nullptr;
+    }
+}
+
+void Dictionary::clearLookupCache() {
+    for (CacheSlot& slot : lookupCache) {
+        slot.node = nullptr;
+    }
+}
+
+// Enable the membership filter, sized for 'expectedEntries' at the given
+// false-positive rate, and populate it from the current contents.
+void Dictionary::enableMembershipFilter(std::size_t expectedEntries, double falsePositiveRate) {
+    if (!(falsePositiveRate > 0.0 && falsePositiveRate < 1.0)) { // Also rejects NaN
+        throw std::invalid_argument("Dictionary: false-positive rate must lie strictly between 0 and 1");
+    }
+    filter.configure(expectedEntries > count ? expectedEntries : count, falsePositiveRate);
+    filter.negatives = 0;
+    filter.falsePositives = 0;
+    filter.rebuilds = 0;
+    addToFilterWorker(root);
+}
+
+void Dictionary::disableMembershipFilter() {
+    filter = CountingBloomFilter();
+}
+
+Dictionary::FilterStats Dictionary::filterStats() const {
+    FilterStats stats = { filter.counters.size(), filter.hashes, filter.counters.size(),
+        0.0, filter.negatives, filter.falsePositives, filter.rebuilds };
+    if (!filter.counters.empty()) {
+        stats.falsePositiveRate = blockedFalsePositiveRate(count, filter.counters.size(), filter.hashes);
+    }
+    return stats;
+}
+
+void Dictionary::addToFilterWorker(Node* node) {
+    if (node != nullptr) {
+        filter.add(node->key);
+        addToFilterWorker(node->left);
+        addToFilterWorker(node->right);
+    }
+}
+
+// Expected false-positive rate of a filter of 'm' counters in 64-counter
+// blocks holding 'n' entries with 'k' hashes: the classic (1 - e^(-kj/64))^k
+// averaged over the Poisson-distributed number of entries j in a block.
+double Dictionary::blockedFalsePositiveRate(std::size_t n, std::size_t m, std::size_t k) {
+    double lambda = 64.0 * n / m;
+    double poisson = std::exp(-lambda); // P(j = 0)
+    double rate = 0;
+    double limit = lambda + 10 * std::sqrt(lambda) + 20;
+    for (double j = 0; j <= limit; ++j) {
+        if (j > 0) {
+            poisson *= lambda / j;
+        }
+        rate += poisson * std::pow(1.0 - std::exp(-(k * j) / 64.0), static_cast<double>(k));
+    }
+    return rate;
+}
+
+// Start from the classic sizing (m = -n ln p / ln^2 2) and grow m until the
+// blocked layout, with its best hash count, also meets the requested rate.
+void Dictionary::CountingBloomFilter::configure(std::size_t expectedEntries, double falsePositiveRate) {
+    const double ln2 = std::log(2.0);
+    const std::size_t maxHashes = 16; // More only saturates a 64-counter block
+    std::size_t n = expectedEntries > 0 ? expectedEntries : 1;
+    double m = std::ceil(-(n * std::log(falsePositiveRate)) / (ln2 * ln2));
+    std::size_t blocks, bestHashes;
+    double bestRate;
+    do {
+        blocks = static_cast<std::size_t>(std::ceil(m / 64));
+        blocks = blocks > 0 ? blocks : 1;
+        bestHashes = 1;
+        bestRate = blockedFalsePositiveRate(n, blocks * 64, 1);
+        for (std::size_t k = 2; k <= maxHashes; ++k) {
+            double rate = blockedFalsePositiveRate(n, blocks * 64, k);
+            if (rate < bestRate) {
+                bestRate = rate;
+                bestHashes = k;
+            }
+        }
+        m *= 1.1;
+    } while (bestRate > falsePositiveRate);
+
+    counters.assign(blocks * 64, 0);
+    hashes = bestHashes;
+    capacity = expectedEntries;
+    targetRate = falsePositiveRate;
+}
+
+// SplitMix64 finaliser; spreads consecutive keys over unrelated counters.
+static unsigned long long mix64(unsigned long long h) {
+    h += 0x9E3779B97F4A7C15ull;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+static unsigned long long mixKey(int key) {
+    return mix64(static_cast<unsigned int>(key));
+}
+
+// Counter for the i-th hash function. The filter is blocked: the key hash
+// picks one 64-counter (cache-line) block and six-bit slices of a second
+// hash pick counters within it, so a probe touches a single cache line.
+std::size_t Dictionary::CountingBloomFilter::counterFor(unsigned long long hash, std::size_t i) const {
+    std::size_t block = static_cast<std::size_t>(hash % (counters.size() / 64));
+    unsigned long long bits = mix64(hash ^ (i / 10));
+    return block * 64 + static_cast<std::size_t>((bits >> (6 * (i % 10))) & 63);
+}
+
+void Dictionary::CountingBloomFilter::add(int key) {
+    unsigned long long hash = mixKey(key);
+    for (std::size_t i = 0; i < hashes; ++i) {
+        unsigned char& c = counters[counterFor(hash, i)];
+        if (c != 255) {
+            ++c; // Saturated counters stick, so they never under-count.
+        }
+    }
+}
+
+void Dictionary::CountingBloomFilter::remove(int key) {
+    unsigned long long hash = mixKey(key);
+    for (std::size_t i = 0; i < hashes; ++i) {
+        unsigned char& c = counters[counterFor(hash, i)];
+        if (c != 255 && c != 0) {
+            --c;
+        }
+    }
+}
+
+bool Dictionary::CountingBloomFilter::mayContain(int key) const {
+    unsigned long long hash = mixKey(key);
+    for (std::size_t i = 0; i < hashes; ++i) {
+        if (counters[counterFor(hash, i)] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bytes attributed to an entry when enforcing a byte budget.
+std::size_t Dictionary::entryBytes(const Node* node) {
+    return sizeof(Node) + node->item.size();
+}
+
+bool Dictionary::isBounded() const {
+    return maxEntries != 0 || maxBytes != 0;
+}
+
+// Limit the entry count and/or bytes held (0 = no limit), evicting the least
+// recently used entries if the dictionary is already over them.
+void Dictionary::setCapacity(std::size_t entryLimit, std::size_t byteLimit) {
+    bool wasBounded = isBounded();
+    maxEntries = entryLimit;
+    maxBytes = byteLimit;
+
+    if (!wasBounded && isBounded()) {
+        threadLruWorker(root); // Existing entries start out in key order
+    }
+    else if (wasBounded && !isBounded()) {
+        while (lruHead != nullptr) {
+            unlinkLru(lruHead);
+        }
+    }
+    if (isBounded()) {
+        enforceBounds(nullptr);
+    }
+}
+
+// Drop every entry whose TTL has passed, oldest expiry first.
+std::size_t Dictionary::removeExpired() {
+    std::size_t removed = 0;
+    Clock::time_point now = Clock::now();
+    while (!expiryIndex.empty() && expiryIndex.begin()->first <= now) {
+        remove(expiryIndex.begin()->second); // Also erases the index entry
+        ++removed;
+    }
+    expirationCount += removed;
+    return removed;
+}
+
+Dictionary::EvictionStats Dictionary::evictionStats() const {
+    return EvictionStats{ evictionCount, expirationCount, byteCount };
+}
+
+// Expire what is due, then evict from the cold end of the recency list until
+// the limits hold. 'keep' (the entry just written) is never evicted.
+void Dictionary::enforceBounds(Node* keep) {
+    removeExpired();
+    while (lruTail != nullptr && lruTail != keep
+        && ((maxEntries != 0 && count > maxEntries) || (maxBytes != 0 && byteCount > maxBytes))) {
+        remove(lruTail->key);
+        ++evictionCount;
+    }
+}
+
+void Dictionary::pushLruFront(Node* node) {
+    node->lruPrev = nullptr;
+    node->lruNext = lruHead;
+    if (lruHead != nullptr) {
+        lruHead->lruPrev = node;
+    }
+    lruHead = node;
+    if (lruTail == nullptr) {
+        lruTail = node;
+    }
+}
+
+void Dictionary::unlinkLru(Node* node) {
+    if (node->lruPrev != nullptr) {
+        node->lruPrev->lruNext = node->lruNext;
+    }
+    else if (lruHead == node) {
+        lruHead = node->lruNext;
+    }
+    if (node->lruNext != nullptr) {
+        node->lruNext->lruPrev = node->lruPrev;
+    }
+    else if (lruTail == node) {
+        lruTail = node->lruPrev;
+    }
+    node->lruPrev = nullptr;
+    node->lruNext = nullptr;
+}
+
+// Thread a subtree onto the recency list so that smaller keys are evicted first.
+void Dictionary::threadLruWorker(Node* node) {
+    if (node != nullptr) {
+        threadLruWorker(node->left);
+        pushLruFront(node);
+        threadLruWorker(node->right);
+    }
+}
+
+// Take the limits, expiry index and recency order of 'other', whose tree has
+// just been copied into this one.
+void Dictionary::copyBoundedState(const Dictionary& other) {
+    maxEntries = other.maxEntries;
+    maxBytes = other.maxBytes;
+    expiryIndex = other.expiryIndex;
+    evictionCount = other.evictionCount;
+    expirationCount = other.expirationCount;
+    lruHead = nullptr;
+    lruTail = nullptr;
+
+    // Walk the source list from its cold end so the copy ends up in the same order.
+    for (Node* source = other.lruTail; source != nullptr; source = source->lruPrev) {
+        pushLruFront(lookupWorker(root, source->key));
+    }
+}
+
+// Leave a moved-from dictionary unbounded with no recency list or expiries.
+void Dictionary::resetBoundedState() {
+    maxEntries = 0;
+    maxBytes = 0;
+    lruHead = nullptr;
+    lruTail = nullptr;
+    expiryIndex.clear();
+    evictionCount = 0;
+    expirationCount = 0;
+}
+
+void Dictionary::enableHashIndex() {
+    hashIndex.reset(count);
+    indexTreeWorker(root);
+}
+
+void Dictionary::disableHashIndex() {
+    hashIndex = NodeHashIndex();
+}
+
+Dictionary::IndexStats Dictionary::hashIndexStats() const {
+    std::size_t slots = hashIndex.slots.size();
+    return IndexStats{ slots, slots * sizeof(NodeHashIndex::Slot),
+        slots > 0 ? static_cast<double>(hashIndex.used) / slots : 0.0 };
+}
+
+void Dictionary::indexTreeWorker(Node* node) {
+    if (node != nullptr) {
+        hashIndex.insert(node);
+        indexTreeWorker(node->left);
+        indexTreeWorker(node->right);
+    }
+}
+
+// Empty the table, sized so 'expectedEntries' keep it at most half full.
+void Dictionary::NodeHashIndex::reset(std::size_t expectedEntries) {
+    std::size_t size = 16;
+    while (size < 2 * expectedEntries) {
+        size <<= 1;
+    }
+    slots.assign(size, Slot{ 0, nullptr });
+    used = 0;
+}
+
+std::size_t Dictionary::NodeHashIndex::home(int key) const {
+    unsigned long long h = static_cast<unsigned int>(key) * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(h >> 32) & (slots.size() - 1);
+}
+
+// Add a node whose key is not yet indexed, doubling the table past half full.
+void Dictionary::NodeHashIndex::insert(Node* node) {
+    if (2 * (used + 1) > slots.size()) {
+        std::vector<Slot> old;
+        old.swap(slots);
+        reset(used + 1);
+        for (const Slot& slot : old) {
+            if (slot.node != nullptr) {
+                insert(slot.node);
+            }
+        }
+    }
+
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = home(node->key);
+    while (slots[i].node != nullptr) {
+        i = (i + 1) & mask;
+    }
+    slots[i].key = node->key;
+    slots[i].node = node;
+    ++used;
+}
+
+Dictionary::Node* Dictionary::NodeHashIndex::find(int key) const {
+    std::size_t mask = slots.size() - 1;
+    for (std::size_t i = home(key); slots[i].node != nullptr; i = (i + 1) & mask) {
+        if (slots[i].key == key) {
+            return slots[i].node;
+        }
+    }
+    return nullptr;
+}
+
+// Remove a key, shifting later members of its probe run back so that lookups
+// never need tombstones.
+void Dictionary::NodeHashIndex::erase(int key) {
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = home(key);
+    while (slots[i].node != nullptr && slots[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    if (slots[i].node == nullptr) {
+        return;
+    }
+
+    std::size_t hole = i;
+    for (std::size_t j = (i + 1) & mask; slots[j].node != nullptr; j = (j + 1) & mask) {
+        // Slot j may fill the hole unless its home lies cyclically in (hole, j].
+        std::size_t h = home(slots[j].key);
+        bool stays = hole <= j ? (hole < h && h <= j) : (hole < h || h <= j);
+        if (!stays) {
+            slots[hole] = slots[j];
+            hole = j;
+        }
+    }
+    slots[hole].node = nullptr;
+    --used;
+}
+
+void Dictionary::enableItemIndex() {
+    itemIndex = ItemIndex();
+    itemIndex.enabled = true;
+    forEach([this](int key, const std::string& item) { itemIndex.add(item, key); });
+}
+
+void Dictionary::disableItemIndex() {
+    itemIndex = ItemIndex();
+}
+
+std::vector<int> Dictionary::keysFor(const std::string& item) const {
+    std::vector<int> keys;
+    if (!itemIndex.enabled) {
+        forEach([&](int key, const std::string& value) {
+            if (value == item) {
+                keys.push_back(key);
+            }
+        });
+        return keys;
+    }
+    auto set = itemIndex.sets.find(item);
+    if (set != itemIndex.sets.end()) {
+        keys.reserve(set->second.count);
+        set->second.appendTo(keys);
+    }
+    return keys;
+}
+
+// Per item: the map node (two pointers beside the pair), the text beyond the
+// string object, and the key set; plus the bucket array.
+Dictionary::ItemIndexStats Dictionary::itemIndexStats() const {
+    std::size_t bytes = itemIndex.sets.bucket_count() * sizeof(void*);
+    for (const auto& set : itemIndex.sets) {
+        bytes += sizeof(set) + 2 * sizeof(void*) + set.second.memoryBytes();
+        if (set.first.capacity() >= sizeof(std::string)) {
+            bytes += set.first.capacity() + 1; // Not held inline
+        }
+    }
+    return ItemIndexStats{ itemIndex.sets.size(), bytes };
+}
+
+void Dictionary::ItemIndex::add(const std::string& item, int key) {
+    sets[item].add(key);
+}
+
+void Dictionary::ItemIndex::remove(const std::string& item, int key) {
+    auto set = sets.find(item);
+    if (set != sets.end()) {
+        set->second.remove(key);
+        if (set->second.count == 0) {
+            sets.erase(set);
+        }
+    }
+}
+
+// Flipping the sign bit makes unsigned order match signed key order.
+static std::uint32_t orderedKeyBits(int key) {
+    return static_cast<std::uint32_t>(key) ^ 0x80000000u;
+}
+
+// Small sets are a sorted array of whole keys; containers only pay off once
+// keys share their high halves. Up to 4096 low halves take no more room than
+// a container's 8 KiB bitmap.
+static const std::size_t smallSetLimit = 64;
+static const std::size_t arrayContainerLimit = 4096;
+
+// The container for a key's high half, or the position it would take.
+template <typename Containers>
+static auto findContainer(Containers& containers, std::uint16_t high) -> decltype(containers.begin()) {
+    return std::lower_bound(containers.begin(), containers.end(), high,
+        [](const typename Containers::value_type& c, std::uint16_t h) { return c.high < h; });
+}
+
+void Dictionary::ItemKeySet::add(int key) {
+    if (containers.empty()) {
+        auto at = std::lower_bound(small.begin(), small.end(), key);
+        if (at != small.end() && *at == key) {
+            return;
+        }
+        small.insert(at, key);
+        ++count;
+        if (small.size() > smallSetLimit) {
+            std::vector<int> members;
+            members.swap(small);
+            count = 0;
+            for (int member : members) {
+                addToContainer(member);
+            }
+        }
+        return;
+    }
+    addToContainer(key);
+}
+
+void Dictionary::ItemKeySet::addToContainer(int key) {
+    std::uint32_t bits = orderedKeyBits(key);
+    std::uint16_t high = static_cast<std::uint16_t>(bits >> 16);
+    std::uint16_t low = static_cast<std::uint16_t>(bits);
+    auto container = findContainer(containers, high);
+    if (container == containers.end() || container->high != high) {
+        container = containers.insert(container, Container{ high, 0, {}, {} });
+    }
+
+    if (!container->bitmap.empty()) {
+        std::uint64_t& word = container->bitmap[low >> 6];
+        std::uint64_t bit = std::uint64_t(1) << (low & 63);
+        if (word & bit) {
+            return;
+        }
+        word |= bit;
+    }
+    else {
+        auto at = std::lower_bound(container->array.begin(), container->array.end(), low);
+        if (at != container->array.end() && *at == low) {
+            return;
+        }
+        container->array.insert(at, low);
+        if (container->array.size() > arrayContainerLimit) {
+            container->bitmap.assign(1024, 0);
+            for (std::uint16_t member : container->array) {
+                container->bitmap[member >> 6] |= std::uint64_t(1) << (member & 63);
+            }
+            std::vector<std::uint16_t>().swap(container->array);
+        }
+    }
+    ++container->size;
+    ++count;
+}
+
+// Sets keep their containers, and groups their bitmaps, once they have grown
+// that far, so removal never allocates.
+void Dictionary::ItemKeySet::remove(int key) {
+    if (containers.empty()) {
+        auto at = std::lower_bound(small.begin(), small.end(), key);
+        if (at != small.end() && *at == key) {
+            small.erase(at);
+            --count;
+        }
+        return;
+    }
+    std::uint32_t bits = orderedKeyBits(key);
+    std::uint16_t high = static_cast<std::uint16_t>(bits >> 16);
+    std::uint16_t low = static_cast<std::uint16_t>(bits);
+    auto container = findContainer(containers, high);
+    if (container == containers.end() || container->high != high) {
+        return;
+    }
+
+    if (!container->bitmap.empty()) {
+        std::uint64_t& word = container->bitmap[low >> 6];
+        std::uint64_t bit = std::uint64_t(1) << (low & 63);
+        if (!(word & bit)) {
+            return;
+        }
+        word &= ~bit;
+    }
+    else {
+        auto at = std::lower_bound(container->array.begin(), container->array.end(), low);
+        if (at == container->array.end() || *at != low) {
+            return;
+        }
+        container->array.erase(at);
+    }
+    --count;
+    if (--container->size == 0) {
+        containers.erase(container);
+    }
+}
+
+bool Dictionary::ItemKeySet::contains(int key) const {
+    if (containers.empty()) {
+        return std::binary_search(small.begin(), small.end(), key);
+    }
+    std::uint32_t bits = orderedKeyBits(key);
+    std::uint16_t high = static_cast<std::uint16_t>(bits >> 16);
+    std::uint16_t low = static_cast<std::uint16_t>(bits);
+    auto container = findContainer(containers, high);
+    if (container == containers.end() || container->high != high) {
+        return false;
+    }
+    if (!container->bitmap.empty()) {
+        return (container->bitmap[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(container->array.begin(), container->array.end(), low);
+}
+
+void Dictionary::ItemKeySet::appendTo(std::vector<int>& keys) const {
+    keys.insert(keys.end(), small.begin(), small.end());
+    for (const Container& container : containers) {
+        std::uint32_t base = static_cast<std::uint32_t>(container.high) << 16;
+        if (container.bitmap.empty()) {
+            for (std::uint16_t low : container.array) {
+                keys.push_back(static_cast<int>((base | low) ^ 0x80000000u));
+            }
+            continue;
+        }
+        for (std::uint32_t word = 0; word < container.bitmap.size(); ++word) {
+            for (std::uint64_t bits = container.bitmap[word]; bits != 0; bits &= bits - 1) {
+                std::uint32_t bit = 0;
+                while (!((bits >> bit) & 1)) {
+                    ++bit;
+                }
+                keys.push_back(static_cast<int>((base | word << 6 | bit) ^ 0x80000000u));
+            }
+        }
+    }
+}
+
+std::size_t Dictionary::ItemKeySet::memoryBytes() const {
+    std::size_t bytes = small.capacity() * sizeof(int) + containers.capacity() * sizeof(Container);
+    for (const Container& container : containers) {
+        bytes += container.array.capacity() * sizeof(std::uint16_t) + container.bitmap.capacity() * sizeof(std::uint64_t);
+    }
+    return bytes;
+}
+
+// Check the tree against everything kept alongside it: key order, the entry
+// and byte counts, subtree hashes, the lookup cache, filter, hash index, item
+// index, recency list and expiry index. Iterative, so degenerate trees do not exhaust the stack.
+std::string Dictionary::checkInvariants() const {
+    settleHashes();
+    std::vector<const Node*> nodes;
+    std::vector<const Node*> stack;
+    const Node* node = root;
+    while (node != nullptr || !stack.empty()) {
+        while (node != nullptr) {
+            if (nodes.size() + stack.size() > count) {
+                return "more nodes reachable than the count of " + std::to_string(count);
+            }
+            stack.push_back(node);
+            node = node->left;
+        }
+        node = stack.back();
+        stack.pop_back();
+        if (!nodes.empty() && nodes.back()->key >= node->key) {
+            return "key " + std::to_string(node->key) + " is out of order after " + std::to_string(nodes.back()->key);
+        }
+        nodes.push_back(node);
+        node = node->right;
+    }
+    if (nodes.size() != count) {
+        return "count is " + std::to_string(count) + " but the tree holds " + std::to_string(nodes.size());
+    }
+
+    std::size_t bytes = 0;
+    std::size_t expiring = 0;
+    for (const Node* entry : nodes) {
+        bytes += entryBytes(entry);
+        if (entry->expiresAt != Clock::time_point::max()) {
+            ++expiring;
+            if (expiryIndex.count(std::make_pair(entry->expiresAt, entry->key)) == 0) {
+                return "key " + std::to_string(entry->key) + " has a TTL but no expiry index entry";
+            }
+        }
+        if (!filter.counters.empty() && !filter.mayContain(entry->key)) {
+            return "membership filter rejects present key " + std::to_string(entry->key);
+        }
+        if (ownHash(entry) != entryHash(entry->key, entry->item)) {
+            return "subtree hash is stale at key " + std::to_string(entry->key);
+        }
+        if (!hashIndex.slots.empty() && hashIndex.find(entry->key) != entry) {
+            return "hash index does not map key " + std::to_string(entry->key) + " to its node";
+        }
+        if (itemIndex.enabled) {
+            auto set = itemIndex.sets.find(entry->item);
+            if (set == itemIndex.sets.end() || !set->second.contains(entry->key)) {
+                return "item index does not list key " + std::to_string(entry->key) + " under its item";
+            }
+        }
+    }
+    if (bytes != byteCount) {
+        return "byte count is " + std::to_string(byteCount) + " but entries hold " + std::to_string(bytes);
+    }
+    if (expiring != expiryIndex.size()) {
+        return "expiry index has " + std::to_string(expiryIndex.size()) + " entries for " + std::to_string(expiring) + " expiring keys";
+    }
+    if (!hashIndex.slots.empty() && hashIndex.used != count) {
+        return "hash index holds " + std::to_string(hashIndex.used) + " keys for " + std::to_string(count) + " entries";
+    }
+    std::size_t itemIndexed = 0;
+    for (const auto& set : itemIndex.sets) {
+        itemIndexed += set.second.count;
+    }
+    if (itemIndexed != (itemIndex.enabled ? count : 0)) {
+        return "item index holds " + std::to_string(itemIndexed) + " keys for " + std::to_string(count) + " entries";
+    }
+
+    // Cached and recency-listed nodes must all be live.
+    std::vector<const Node*> live(nodes);
+    std::sort(live.begin(), live.end());
+    auto isLive = [&](const Node* entry) { return std::binary_search(live.begin(), live.end(), entry); };
+    for (const CacheSlot& slot : lookupCache) {
+        if (slot.node != nullptr && (!isLive(slot.node) || slot.node->key != slot.key)) {
+            return "lookup cache holds a stale node for key " + std::to_string(slot.key);
+        }
+    }
+
+    std::size_t listed = 0;
+    const Node* previous = nullptr;
+    for (const Node* entry = lruHead; entry != nullptr; entry = entry->lruNext) {
+        if (++listed > count || !isLive(entry) || entry->lruPrev != previous) {
+            return "recency list is broken at entry " + std::to_string(listed);
+        }
+        previous = entry;
+    }
+    if (previous != lruTail || listed != (isBounded() ? count : 0)) {
+        return "recency list has " + std::to_string(listed) + " entries for " + std::to_string(count) + " keys";
+    }
+    return std::string();
+}
+
+std::size_t Dictionary::height() const {
+    std::size_t levels = 0;
+    std::vector<const Node*> level;
+    if (root != nullptr) {
+        level.push_back(root);
+    }
+    std::vector<const Node*> next;
+    while (!level.empty()) {
+        ++levels;
+        next.clear();
+        for (const Node* node : level) {
+            if (node->left != nullptr) next.push_back(node->left);
+            if (node->right != nullptr) next.push_back(node->right);
+        }
+        level.swap(next);
+    }
+    return levels;
+}
+
+// FNV-1a over the item, finished together with the key by SplitMix64, so the
+// hash is the same in every process and on every platform.
+std::uint64_t Dictionary::entryHash(int key, const std::string& item) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (char c : item) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return mix64(hash ^ mixKey(key));
+}
+
+std::uint64_t Dictionary::subtreeHashOf(const Node* node) {
+    return node != nullptr ? node->subtreeHash : 0;
+}
+
+// The node's own entry hash, recovered from the sums without rehashing.
+std::uint64_t Dictionary::ownHash(const Node* node) {
+    return node->subtreeHash - subtreeHashOf(node->left) - subtreeHashOf(node->right);
+}
+
+// Owe 'delta' to the nodes holding every link of 'path' but the last, whose
+// subtree the insert or remove worker has already updated. It is left on
+// the link above the last and carried further up only as links are popped.
+void Dictionary::deferAlongPath(std::vector<PathLink>& path, std::uint64_t delta) {
+    if (path.size() > 1) {
+        path[path.size() - 2].pending += delta;
+    }
+}
+
+// Apply the delta pending on link 'i' to its node, passing it to the link
+// above, whose node holds that subtree.
+void Dictionary::settleLink(std::vector<PathLink>& path, std::size_t i) {
+    std::uint64_t pending = path[i].pending;
+    if (pending != 0) {
+        (*path[i].link)->subtreeHash += pending;
+        if (i > 0) {
+            path[i - 1].pending += pending;
+        }
+        path[i].pending = 0;
+    }
+}
+
+// Apply every deferred delta, deepest link first: O(path length), once per
+// read or reshape that follows a run of batch or cursor writes.
+void Dictionary::settleHashes() const {
+    if (deferredPath != nullptr) {
+        for (std::size_t i = deferredPath->size(); i-- > 0;) {
+            settleLink(*deferredPath, i);
+        }
+        deferredPath = nullptr;
+    }
+}
+
+std::uint64_t Dictionary::contentHash() const {
+    settleHashes();
+    return subtreeHashOf(root);
+}
+
+bool Dictionary::contentEquals(const Dictionary& other) const {
+    return count == other.count && contentHash() == other.contentHash();
+}
+
+// Both sides of a key range are described as forests of whole subtrees and
+// single nodes whose entries are exactly those in the range. Ranges whose
+// sums agree are skipped. Otherwise both forests are split at the key of a
+// node from one side, comparing the entries for that key, and each half is
+// compared in turn. When the shapes match, each forest stays a single
+// subtree, so only the paths to the differences are visited.
+std::vector<int> Dictionary::diff(const Dictionary& other) const {
+    settleHashes();
+    other.settleHashes();
+    struct Piece {
+        const Node* node;
+        bool whole; // The node's subtree, or just the node
+    };
+    typedef std::vector<Piece> Forest;
+
+    auto sum = [](const Forest& forest) {
+        std::uint64_t hash = 0;
+        for (const Piece& piece : forest) {
+            hash += piece.whole ? piece.node->subtreeHash : ownHash(piece.node);
+        }
+        return hash;
+    };
+    auto split = [](const Forest& forest, int key, Forest& below, Forest& above) {
+        const Node* match = nullptr;
+        for (const Piece& piece : forest) {
+            if (!piece.whole) {
+                if (piece.node->key != key) {
+                    (piece.node->key < key ? below : above).push_back(piece);
+                }
+                else {
+                    match = piece.node;
+                }
+                continue;
+            }
+            const Node* node = piece.node;
+            while (node != nullptr && node->key != key) {
+                if (node->key < key) {
+                    below.push_back(Piece{ node, false });
+                    if (node->left != nullptr) {
+                        below.push_back(Piece{ node->left, true });
+                    }
+                    node = node->right;
+                }
+                else {
+                    above.push_back(Piece{ node, false });
+                    if (node->right != nullptr) {
+                        above.push_back(Piece{ node->right, true });
+                    }
+                    node = node->left;
+                }
+            }
+            if (node != nullptr) {
+                match = node;
+                if (node->left != nullptr) {
+                    below.push_back(Piece{ node->left, true });
+                }
+                if (node->right != nullptr) {
+                    above.push_back(Piece{ node->right, true });
+                }
+            }
+        }
+        return match;
+    };
+    auto collect = [](const Forest& forest, std::vector<int>& keys) {
+        for (const Piece& piece : forest) {
+            if (!piece.whole) {
+                keys.push_back(piece.node->key);
+                continue;
+            }
+            std::vector<const Node*> stack(1, piece.node);
+            while (!stack.empty()) {
+                const Node* node = stack.back();
+                stack.pop_back();
+                keys.push_back(node->key);
+                if (node->left != nullptr) stack.push_back(node->left);
+                if (node->right != nullptr) stack.push_back(node->right);
+            }
+        }
+    };
+
+    std::vector<int> changed;
+    std::vector<std::pair<Forest, Forest>> work; // Iterative: splits of a degenerate tree go deep
+    work.emplace_back(Forest(), Forest());
+    if (root != nullptr) {
+        work.back().first.push_back(Piece{ root, true });
+    }
+    if (other.root != nullptr) {
+        work.back().second.push_back(Piece{ other.root, true });
+    }
+    while (!work.empty()) {
+        Forest mine = std::move(work.back().first);
+        Forest theirs = std::move(work.back().second);
+        work.pop_back();
+        if (sum(mine) == sum(theirs)) {
+            continue;
+        }
+        if (mine.empty() || theirs.empty()) {
+            collect(mine.empty() ? theirs : mine, changed);
+            continue;
+        }
+
+        // Split at a whole subtree's root where there is one, which keeps
+        // matching shapes in lockstep.
+        const Forest& source = mine.size() <= theirs.size() ? mine : theirs;
+        const Piece* pivot = &source.front();
+        for (const Piece& piece : source) {
+            if (piece.whole) {
+                pivot = &piece;
+                break;
+            }
+        }
+        int key = pivot->node->key;
+        work.emplace_back();
+        work.emplace_back();
+        std::pair<Forest, Forest>& below = work[work.size() - 2];
+        std::pair<Forest, Forest>& above = work.back();
+        const Node* a = split(mine, key, below.first, above.first);
+        const Node* b = split(theirs, key, below.second, above.second);
+        if ((a == nullptr) != (b == nullptr) || (a != nullptr && a->item != b->item)) {
+            changed.push_back(key);
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    return changed;
+}
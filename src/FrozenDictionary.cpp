@@ -0,0 +1,428 @@
+#include "FrozenDictionary.h"
+#include <algorithm>
+#include <new>
+#include <utility>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#include <cstdlib>
+#include <fstream>
+#endif
+
+const std::size_t FrozenDictionary::packedBlockKeys;
+
+FrozenDictionary::FrozenDictionary(const Dictionary& source, Layout layout, bool useHugePages)
+    : FrozenDictionary(layout, useHugePages) {
+    rebuild(source);
+}
+
+FrozenDictionary::FrozenDictionary(Layout layout, bool useHugePages)
+    : shape(layout), wantHugePages(useHugePages), gotHugePages(false), buffer(nullptr), capacity(0), count(0),
+      usedBytes(0), blockCount(0), headersAt(0), wordsAt(0) {}
+
+FrozenDictionary::~FrozenDictionary() {
+    release();
+}
+
+// Copy the entries out in key order and lay them out again. The new layout
+// is built aside and swapped in, so a failed rebuild keeps the old one; the
+// old buffer is released only after the new one is complete.
+void FrozenDictionary::rebuild(const Dictionary& source) {
+    std::vector<int> keys;
+    std::vector<std::string> sortedItems;
+    keys.reserve(source.size());
+    sortedItems.reserve(source.size());
+    source.forEach([&](int key, const std::string& item) {
+        keys.push_back(key);
+        sortedItems.push_back(item);
+    });
+
+    FrozenDictionary fresh(shape, wantHugePages);
+    fresh.count = keys.size();
+    switch (shape) {
+    case Layout::Sorted: fresh.buildSorted(keys, sortedItems); break;
+    case Layout::Eytzinger: fresh.buildEytzinger(keys, sortedItems); break;
+    case Layout::VanEmdeBoas: fresh.buildVanEmdeBoas(keys, sortedItems); break;
+    case Layout::Packed: fresh.buildPacked(keys, sortedItems); break;
+    }
+    swap(fresh);
+}
+
+void FrozenDictionary::swap(FrozenDictionary& other) {
+    std::swap(gotHugePages, other.gotHugePages);
+    std::swap(buffer, other.buffer);
+    std::swap(capacity, other.capacity);
+    std::swap(count, other.count);
+    std::swap(usedBytes, other.usedBytes);
+    std::swap(blockCount, other.blockCount);
+    std::swap(headersAt, other.headersAt);
+    std::swap(wordsAt, other.wordsAt);
+    items.swap(other.items);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Buffer
+
+// Huge pages are best effort: large pages need a privilege on Windows, and
+// transparent huge pages on Linux are only advised.
+void FrozenDictionary::allocate(std::size_t bytes) {
+    gotHugePages = false;
+    usedBytes = bytes;
+    if (bytes == 0) {
+        return;
+    }
+#if defined(_WIN32)
+    SIZE_T largePage = GetLargePageMinimum();
+    if (wantHugePages && largePage != 0) {
+        capacity = (bytes + largePage - 1) / largePage * largePage;
+        buffer = VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        gotHugePages = buffer != nullptr;
+    }
+    if (buffer == nullptr) {
+        capacity = bytes;
+        buffer = VirtualAlloc(nullptr, capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    if (buffer == nullptr) {
+        throw std::bad_alloc();
+    }
+#elif defined(__linux__)
+    // Map an extra huge page so the buffer can start on a 2 MiB boundary,
+    // then trim the slack on both sides.
+    const std::size_t hugePage = std::size_t(2) << 20;
+    capacity = (bytes + hugePage - 1) / hugePage * hugePage;
+    void* raw = mmap(nullptr, capacity + hugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    char* start = static_cast<char*>(raw);
+    char* aligned = reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(start) + hugePage - 1) & ~(hugePage - 1));
+    if (aligned != start) {
+        munmap(start, aligned - start);
+    }
+    std::size_t tail = (start + capacity + hugePage) - (aligned + capacity);
+    if (tail != 0) {
+        munmap(aligned + capacity, tail);
+    }
+    buffer = aligned;
+    // Opt out explicitly too, so the comparison holds when THP is "always".
+    // The advice only makes the kernel willing; hugePages() asks what it did.
+    gotHugePages = madvise(buffer, capacity, wantHugePages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) == 0 && wantHugePages;
+#else
+    capacity = bytes;
+    buffer = ::operator new(capacity);
+#endif
+}
+
+void FrozenDictionary::release() {
+    if (buffer != nullptr) {
+#if defined(_WIN32)
+        VirtualFree(buffer, 0, MEM_RELEASE);
+#elif defined(__linux__)
+        munmap(buffer, capacity);
+#else
+        ::operator delete(buffer);
+#endif
+    }
+    buffer = nullptr;
+    capacity = 0;
+    usedBytes = 0;
+    blockCount = 0;
+    items.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Layouts
+
+void FrozenDictionary::buildSorted(const std::vector<int>& keys, std::vector<std::string>& sortedItems) {
+    allocate(count * sizeof(int));
+    std::copy(keys.begin(), keys.end(), static_cast<int*>(buffer));
+    items.swap(sortedItems);
+}
+
+// Position i holds breadth-first node i + 1 of the complete tree; the
+// in-order rank of each node says which key it takes.
+void FrozenDictionary::buildEytzinger(const std::vector<int>& keys, std::vector<std::string>& sortedItems) {
+    std::vector<std::size_t> rank(count + 1);
+    std::size_t next = 0;
+    bfsToInOrder(1, count, next, rank);
+
+    allocate(count * sizeof(int));
+    int* slots = static_cast<int*>(buffer);
+    items.resize(count);
+    for (std::size_t bfs = 1; bfs <= count; ++bfs) {
+        slots[bfs - 1] = keys[rank[bfs]];
+        items[bfs - 1].swap(sortedItems[rank[bfs]]);
+    }
+}
+
+// The same complete tree as Eytzinger, stored in van Emde Boas order with
+// the children's positions spelled out.
+void FrozenDictionary::buildVanEmdeBoas(const std::vector<int>& keys, std::vector<std::string>& sortedItems) {
+    std::vector<std::size_t> rank(count + 1);
+    std::size_t next = 0;
+    bfsToInOrder(1, count, next, rank);
+
+    int height = 0;
+    while ((std::size_t(1) << height) - 1 < count) {
+        ++height;
+    }
+    std::vector<std::size_t> order; // Breadth-first indices in vEB order
+    order.reserve(count);
+    vebOrder(1, height, count, order);
+    std::vector<std::uint32_t> position(count + 1);
+    for (std::size_t p = 0; p < order.size(); ++p) {
+        position[order[p]] = static_cast<std::uint32_t>(p);
+    }
+
+    allocate(count * sizeof(VebNode));
+    VebNode* nodes = static_cast<VebNode*>(buffer);
+    items.resize(count);
+    for (std::size_t p = 0; p < order.size(); ++p) {
+        std::size_t bfs = order[p];
+        nodes[p].key = keys[rank[bfs]];
+        nodes[p].left = 2 * bfs <= count ? position[2 * bfs] : none;
+        nodes[p].right = 2 * bfs + 1 <= count ? position[2 * bfs + 1] : none;
+        items[p].swap(sortedItems[rank[bfs]]);
+    }
+}
+
+// Gaps are stored as (key - previous - 1) - minDelta, so blocks of
+// consecutive keys pack to zero bits.
+void FrozenDictionary::buildPacked(const std::vector<int>& keys, std::vector<std::string>& sortedItems) {
+    blockCount = (count + packedBlockKeys - 1) / packedBlockKeys;
+    std::vector<PackedBlock> blocks(blockCount);
+    std::size_t totalWords = 0;
+    for (std::size_t b = 0; b < blockCount; ++b) {
+        std::size_t begin = b * packedBlockKeys;
+        std::size_t end = std::min(count, begin + packedBlockKeys);
+        std::uint32_t minDelta = 0xFFFFFFFF;
+        std::uint32_t maxDelta = 0;
+        for (std::size_t i = begin + 1; i < end; ++i) {
+            std::uint32_t delta = static_cast<std::uint32_t>(static_cast<std::int64_t>(keys[i]) - keys[i - 1] - 1);
+            minDelta = std::min(minDelta, delta);
+            maxDelta = std::max(maxDelta, delta);
+        }
+        std::uint32_t width = 0;
+        while (width < 32 && (static_cast<std::uint64_t>(maxDelta - std::min(minDelta, maxDelta)) >> width) != 0) {
+            ++width;
+        }
+        blocks[b] = PackedBlock{ static_cast<std::uint32_t>(totalWords), end - begin > 1 ? minDelta : 0, width };
+        totalWords += ((end - begin - 1) * width + 63) / 64;
+    }
+
+    headersAt = (blockCount * sizeof(int) + 7) / 8 * 8;
+    wordsAt = (headersAt + blockCount * sizeof(PackedBlock) + 7) / 8 * 8;
+    allocate(wordsAt + totalWords * sizeof(std::uint64_t));
+    if (count == 0) {
+        return;
+    }
+
+    char* base = static_cast<char*>(buffer);
+    int* firsts = reinterpret_cast<int*>(base);
+    std::copy(blocks.begin(), blocks.end(), reinterpret_cast<PackedBlock*>(base + headersAt));
+    std::uint64_t* words = reinterpret_cast<std::uint64_t*>(base + wordsAt);
+    std::fill(words, words + totalWords, 0);
+    for (std::size_t b = 0; b < blockCount; ++b) {
+        std::size_t begin = b * packedBlockKeys;
+        std::size_t end = std::min(count, begin + packedBlockKeys);
+        const PackedBlock& block = blocks[b];
+        firsts[b] = keys[begin];
+        if (block.width == 0) {
+            continue; // Every gap equals minDelta; the block owns no words
+        }
+        std::uint64_t* bits = words + block.words;
+        for (std::size_t i = begin + 1; i < end; ++i) {
+            std::uint64_t value = static_cast<std::uint32_t>(static_cast<std::int64_t>(keys[i]) - keys[i - 1] - 1) - block.minDelta;
+            std::size_t position = (i - begin - 1) * block.width;
+            std::size_t shift = position % 64;
+            bits[position / 64] |= value << shift;
+            if (shift + block.width > 64) {
+                bits[position / 64 + 1] |= value >> (64 - shift);
+            }
+        }
+    }
+    items.swap(sortedItems);
+}
+
+// In-order walk of the implicit complete tree with 'n' nodes (1-based).
+void FrozenDictionary::bfsToInOrder(std::size_t bfs, std::size_t n, std::size_t& next, std::vector<std::size_t>& rank) {
+    if (bfs > n) {
+        return;
+    }
+    bfsToInOrder(2 * bfs, n, next, rank);
+    rank[bfs] = next++;
+    bfsToInOrder(2 * bfs + 1, n, next, rank);
+}
+
+// Emit the subtree of 'height' levels under 'bfs': its top half first, then
+// each subtree hanging below the top half, recursively.
+void FrozenDictionary::vebOrder(std::size_t bfs, int height, std::size_t n, std::vector<std::size_t>& order) {
+    if (bfs > n) {
+        return;
+    }
+    if (height == 1) {
+        order.push_back(bfs);
+        return;
+    }
+    int top = height / 2;
+    vebOrder(bfs, top, n, order);
+    for (std::size_t j = 0; j < (std::size_t(1) << top); ++j) {
+        vebOrder((bfs << top) + j, height - top, n, order);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Lookup
+
+const std::string* FrozenDictionary::lookup(int key) const {
+    switch (shape) {
+    case Layout::Sorted: {
+        const int* keys = static_cast<const int*>(buffer);
+        const int* found = std::lower_bound(keys, keys + count, key);
+        return found != keys + count && *found == key ? &items[found - keys] : nullptr;
+    }
+    case Layout::Eytzinger: {
+        const int* slots = static_cast<const int*>(buffer);
+        std::size_t bfs = 1;
+        while (bfs <= count) {
+            int current = slots[bfs - 1];
+            if (current == key) {
+                return &items[bfs - 1];
+            }
+            bfs = 2 * bfs + (key > current ? 1 : 0);
+        }
+        return nullptr;
+    }
+    case Layout::VanEmdeBoas: {
+        const VebNode* nodes = static_cast<const VebNode*>(buffer);
+        std::uint32_t p = count != 0 ? 0 : none;
+        while (p != none) {
+            const VebNode& node = nodes[p];
+            if (node.key == key) {
+                return &items[p];
+            }
+            p = key < node.key ? node.left : node.right;
+        }
+        return nullptr;
+    }
+    case Layout::Packed:
+        return lookupPacked(key);
+    }
+    return nullptr;
+}
+
+// Find the last block starting at or before the key, then add up its gaps
+// until the key is reached or passed.
+const std::string* FrozenDictionary::lookupPacked(int key) const {
+    const char* base = static_cast<const char*>(buffer);
+    const int* firsts = reinterpret_cast<const int*>(base);
+    if (count == 0 || key < firsts[0]) {
+        return nullptr;
+    }
+
+    // Interpolation search keeping firsts[low] <= key < firsts[high], with
+    // every other step a bisection so skewed keys still take O(log) steps.
+    std::size_t low = 0;
+    std::size_t high = blockCount;
+    if (key >= firsts[blockCount - 1]) {
+        low = blockCount - 1;
+    }
+    else {
+        high = blockCount - 1;
+        for (bool bisect = false; high - low > 1; bisect = !bisect) {
+            std::size_t probe;
+            if (bisect) {
+                probe = low + (high - low) / 2;
+            }
+            else {
+                double fraction = (static_cast<double>(key) - firsts[low]) / (static_cast<double>(firsts[high]) - firsts[low]);
+                probe = low + static_cast<std::size_t>(fraction * (high - low));
+                probe = std::min(std::max(probe, low + 1), high - 1);
+            }
+            if (firsts[probe] <= key) {
+                low = probe;
+            }
+            else {
+                high = probe;
+            }
+        }
+    }
+
+    std::size_t begin = low * packedBlockKeys;
+    if (firsts[low] == key) {
+        return &items[begin];
+    }
+    const PackedBlock& block = reinterpret_cast<const PackedBlock*>(base + headersAt)[low];
+    std::size_t length = std::min(count - begin, packedBlockKeys);
+    if (block.width == 0) {
+        // No words to read: the block is an arithmetic run with step minDelta + 1.
+        std::uint64_t offset = static_cast<std::uint64_t>(static_cast<std::int64_t>(key) - firsts[low]);
+        std::uint64_t step = std::uint64_t(block.minDelta) + 1;
+        return offset % step == 0 && offset / step < length ? &items[begin + offset / step] : nullptr;
+    }
+    const std::uint64_t* bits = reinterpret_cast<const std::uint64_t*>(base + wordsAt) + block.words;
+    std::uint64_t mask = (std::uint64_t(1) << block.width) - 1;
+    std::int64_t current = firsts[low];
+    for (std::size_t i = 1; i < length; ++i) {
+        std::size_t position = (i - 1) * block.width;
+        std::size_t shift = position % 64;
+        std::uint64_t value = bits[position / 64] >> shift;
+        if (shift + block.width > 64) {
+            value |= bits[position / 64 + 1] << (64 - shift);
+        }
+        current += static_cast<std::int64_t>(value & mask) + block.minDelta + 1;
+        if (current >= key) {
+            return current == key ? &items[begin + i] : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+std::size_t FrozenDictionary::size() const {
+    return count;
+}
+
+FrozenDictionary::Layout FrozenDictionary::layout() const {
+    return shape;
+}
+
+bool FrozenDictionary::hugePages() const {
+#if defined(__linux__)
+    return gotHugePages && anonHugePageBytes(buffer) != 0;
+#else
+    return gotHugePages;
+#endif
+}
+
+#if defined(__linux__)
+// Bytes of the mapping holding 'address' that the kernel currently backs
+// with transparent huge pages, from its AnonHugePages line in smaps.
+std::size_t FrozenDictionary::anonHugePageBytes(const void* address) {
+    const std::uintptr_t at = reinterpret_cast<std::uintptr_t>(address);
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool inMapping = false;
+    while (std::getline(smaps, line)) {
+        char* end = nullptr;
+        unsigned long long begin = std::strtoull(line.c_str(), &end, 16);
+        if (*end == '-') { // A mapping header, "begin-end perms offset ..."
+            unsigned long long finish = std::strtoull(end + 1, nullptr, 16);
+            inMapping = at >= begin && at < finish;
+        }
+        else if (inMapping && line.compare(0, 14, "AnonHugePages:") == 0) {
+            return static_cast<std::size_t>(std::strtoull(line.c_str() + 14, nullptr, 10)) * 1024;
+        }
+    }
+    return 0;
+}
+#endif
+
+std::size_t FrozenDictionary::bufferBytes() const {
+    return usedBytes;
+}
@@ -0,0 +1,337 @@
+#include "LockFreeDictionary.h"
+#include <functional>
+#include <new>
+#include <thread>
+
+// Removal protocol: the remover marks a node's next pointers from the top
+// level down; marking level 0 is the linearisation point. It then calls find,
+// which unlinks every marked node it passes. An inserter may still be linking
+// the node's upper levels at that time, so both parties hold a reference in
+// 'owners' and the last to finish retires the node, after a final find if it
+// was the inserter. Only then is the node unreachable from the head.
+//
+// Reclamation follows VersionedDictionary: retired objects are tagged with
+// the global epoch and freed once every pinned slot announced a later one.
+// All atomics use sequentially consistent ordering for this argument to hold.
+
+struct LockFreeDictionary::Node {
+    int key;
+    int height;
+    std::atomic<const std::string*> item;
+    std::atomic<int> owners;
+    std::atomic<std::uintptr_t>* next; // 'height' entries, allocated after the node
+};
+
+LockFreeDictionary::LockFreeDictionary()
+    : head(createNode(0, nullptr, maxLevel)), count(0), epoch(1) {
+    for (Slot& slot : slots) {
+        slot.epoch.store(0);
+    }
+}
+
+LockFreeDictionary::~LockFreeDictionary() {
+    Node* node = head;
+    while (node != nullptr) {
+        Node* next = pointer(node->next[0].load());
+        destroyNode(node);
+        node = next;
+    }
+    for (Slot& slot : slots) {
+        for (const Retired& retired : slot.retired) {
+            destroyNode(retired.node);
+            delete retired.item;
+        }
+    }
+}
+
+bool LockFreeDictionary::isMarked(std::uintptr_t next) {
+    return (next & 1) != 0;
+}
+
+LockFreeDictionary::Node* LockFreeDictionary::pointer(std::uintptr_t next) {
+    return reinterpret_cast<Node*>(next & ~std::uintptr_t(1));
+}
+
+std::uintptr_t LockFreeDictionary::bits(const Node* node) {
+    return reinterpret_cast<std::uintptr_t>(node);
+}
+
+// Nodes are sized to their height: the next array follows the node itself.
+LockFreeDictionary::Node* LockFreeDictionary::createNode(int key, const std::string* item, int height) {
+    void* memory = ::operator new(sizeof(Node) + height * sizeof(std::atomic<std::uintptr_t>));
+    Node* node = new (memory) Node;
+    node->key = key;
+    node->height = height;
+    node->item.store(item);
+    node->owners.store(2); // Inserter and eventual remover
+    node->next = reinterpret_cast<std::atomic<std::uintptr_t>*>(node + 1);
+    for (int level = 0; level < height; ++level) {
+        new (&node->next[level]) std::atomic<std::uintptr_t>(0);
+    }
+    return node;
+}
+
+void LockFreeDictionary::destroyNode(Node* node) {
+    if (node != nullptr) {
+        delete node->item.load();
+        node->~Node();
+        ::operator delete(node);
+    }
+}
+
+// Geometric height with p = 1/2 from a per-thread xorshift generator.
+int LockFreeDictionary::randomHeight() {
+    thread_local std::uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    int height = 1;
+    for (std::uint64_t bitsLeft = state; (bitsLeft & 1) != 0 && height < maxLevel; bitsLeft >>= 1) {
+        ++height;
+    }
+    return height;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Reclamation
+
+LockFreeDictionary::Slot& LockFreeDictionary::pin() const {
+    // Threads start probing at different slots so they rarely collide.
+    thread_local std::size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+    for (std::size_t i = 0;; ++i) {
+        Slot& slot = slots[(hint + i) % maxThreads];
+        std::uint64_t expected = 0;
+        if (slot.epoch.load() == 0 && slot.epoch.compare_exchange_strong(expected, epoch.load())) {
+            hint = (hint + i) % maxThreads;
+            return slot;
+        }
+    }
+}
+
+LockFreeDictionary::Guard::Guard(const LockFreeDictionary& owner)
+    : owner(owner), slot(owner.pin()) {}
+
+LockFreeDictionary::Guard::~Guard() {
+    slot.epoch.store(0);
+}
+
+void LockFreeDictionary::Guard::retire(Node* node) {
+    slot.retired.push_back(Retired{ owner.epoch.load(), node, nullptr });
+    reclaim();
+}
+
+void LockFreeDictionary::Guard::retire(const std::string* item) {
+    slot.retired.push_back(Retired{ owner.epoch.load(), nullptr, item });
+    reclaim();
+}
+
+// Advance the epoch and free what every running operation has moved past.
+// Batched so the scan over the slots is amortised.
+void LockFreeDictionary::Guard::reclaim() {
+    if (slot.retired.size() < 128) {
+        return;
+    }
+    std::uint64_t oldestPinned = owner.epoch.fetch_add(1) + 1;
+    for (const Slot& other : owner.slots) {
+        std::uint64_t pinned = other.epoch.load();
+        if (pinned != 0 && pinned < oldestPinned) {
+            oldestPinned = pinned;
+        }
+    }
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < slot.retired.size(); ++i) {
+        if (slot.retired[i].epoch < oldestPinned) {
+            destroyNode(slot.retired[i].node);
+            delete slot.retired[i].item;
+        }
+        else {
+            slot.retired[kept++] = slot.retired[i];
+        }
+    }
+    slot.retired.resize(kept);
+}
+
+// Called by the inserter and by the remover once each is done linking or
+// unlinking the node; the second caller retires it.
+void LockFreeDictionary::releaseNode(Node* node, Guard& guard) const {
+    if (node->owners.fetch_sub(1) == 1) {
+        guard.retire(node);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Search
+
+// Fill preds/succs with the last node before 'key' and the first node at or
+// after it on every level, unlinking marked nodes on the way. Returns the
+// unmarked node holding the key, if any.
+LockFreeDictionary::Node* LockFreeDictionary::find(int key, Node** preds, Node** succs) const {
+    while (!findOnce(key, preds, succs)) {
+        // A predecessor changed under us; start again from the head.
+    }
+    return succs[0] != nullptr && succs[0]->key == key ? succs[0] : nullptr;
+}
+
+bool LockFreeDictionary::findOnce(int key, Node** preds, Node** succs) const {
+    Node* pred = head;
+    for (int level = maxLevel - 1; level >= 0; --level) {
+        Node* curr = pointer(pred->next[level].load());
+        while (curr != nullptr) {
+            std::uintptr_t succ = curr->next[level].load();
+            if (isMarked(succ)) {
+                std::uintptr_t expected = bits(curr);
+                if (!pred->next[level].compare_exchange_strong(expected, succ & ~std::uintptr_t(1))) {
+                    return false;
+                }
+                curr = pointer(succ);
+            }
+            else if (curr->key < key) {
+                pred = curr;
+                curr = pointer(succ);
+            }
+            else {
+                break;
+            }
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return true;
+}
+
+// Read-only search: marked nodes are stepped over but never unlinked.
+bool LockFreeDictionary::lookup(int key, std::string& item) const {
+    Guard guard(*this);
+    const Node* pred = head;
+    const Node* curr = nullptr;
+    for (int level = maxLevel - 1; level >= 0; --level) {
+        curr = pointer(pred->next[level].load());
+        while (curr != nullptr && curr->key < key) {
+            pred = curr;
+            curr = pointer(curr->next[level].load());
+        }
+    }
+    // A removed node may still precede a re-inserted one with the same key.
+    while (curr != nullptr && curr->key == key) {
+        if (!isMarked(curr->next[0].load())) {
+            item = *curr->item.load();
+            return true;
+        }
+        curr = pointer(curr->next[0].load());
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Writers
+
+void LockFreeDictionary::insert(int key, const std::string& item) {
+    Guard guard(*this);
+    Node* preds[maxLevel];
+    Node* succs[maxLevel];
+    for (;;) {
+        Node* found = find(key, preds, succs);
+        if (found != nullptr) {
+            guard.retire(found->item.exchange(new std::string(item))); // Overwrite
+            if (!isMarked(found->next[0].load())) {
+                return;
+            }
+            continue; // Removed meanwhile; insert a fresh node instead
+        }
+
+        int height = randomHeight();
+        Node* node = createNode(key, new std::string(item), height);
+        for (int level = 0; level < height; ++level) {
+            node->next[level].store(bits(succs[level]));
+        }
+        std::uintptr_t expected = bits(succs[0]);
+        if (!preds[0]->next[0].compare_exchange_strong(expected, bits(node))) {
+            destroyNode(node); // Never published
+            continue;
+        }
+        count.fetch_add(1);
+
+        linkUpperLevels(node, preds, succs);
+        if (isMarked(node->next[0].load())) {
+            find(key, preds, succs); // Unlink levels linked after the remover's pass
+        }
+        releaseNode(node, guard);
+        return;
+    }
+}
+
+// Link an already published node into levels 1..height-1, stopping early if
+// it is removed meanwhile.
+void LockFreeDictionary::linkUpperLevels(Node* node, Node** preds, Node** succs) const {
+    for (int level = 1; level < node->height; ++level) {
+        for (;;) {
+            // Only a remover changes an unlinked level, so failure means marked.
+            std::uintptr_t next = node->next[level].load();
+            if (isMarked(next) ||
+                (next != bits(succs[level]) && !node->next[level].compare_exchange_strong(next, bits(succs[level])))) {
+                return;
+            }
+            std::uintptr_t expected = bits(succs[level]);
+            if (preds[level]->next[level].compare_exchange_strong(expected, bits(node))) {
+                break;
+            }
+            find(node->key, preds, succs);
+            if (isMarked(node->next[0].load())) {
+                return;
+            }
+        }
+    }
+}
+
+void LockFreeDictionary::remove(int key) {
+    Guard guard(*this);
+    Node* preds[maxLevel];
+    Node* succs[maxLevel];
+    Node* node = find(key, preds, succs);
+    if (node == nullptr) {
+        return;
+    }
+
+    for (int level = node->height - 1; level >= 1; --level) {
+        std::uintptr_t next = node->next[level].load();
+        while (!isMarked(next) && !node->next[level].compare_exchange_weak(next, next | 1)) {
+        }
+    }
+    std::uintptr_t next = node->next[0].load();
+    for (;;) {
+        if (isMarked(next)) {
+            return; // Another remover won
+        }
+        if (node->next[0].compare_exchange_strong(next, next | 1)) {
+            break;
+        }
+    }
+    count.fetch_sub(1);
+
+    find(key, preds, succs); // Physically unlink it from every level
+    releaseNode(node, guard);
+}
+
+// Collect matching keys in one pass over the bottom level, then remove each.
+void LockFreeDictionary::removeIf(std::function<bool(int)> predicate) {
+    std::vector<int> keysToRemove;
+    {
+        Guard guard(*this);
+        for (Node* node = pointer(head->next[0].load()); node != nullptr; node = pointer(node->next[0].load())) {
+            if (!isMarked(node->next[0].load()) && predicate(node->key)) {
+                keysToRemove.push_back(node->key);
+            }
+        }
+    }
+    for (int key : keysToRemove) {
+        remove(key);
+    }
+}
+
+std::size_t LockFreeDictionary::size() const {
+    return count.load();
+}
@@ -0,0 +1,300 @@
+#include "RadixDictionary.h"
+
+RadixDictionary::RadixDictionary() : root(nullptr), count(0) {}
+
+RadixDictionary::~RadixDictionary() {
+    if (root != nullptr) {
+        deleteWorker(root);
+    }
+}
+
+RadixDictionary::RadixDictionary(const RadixDictionary& other)
+    : root(other.root != nullptr ? copyWorker(other.root) : nullptr), count(other.count) {}
+
+RadixDictionary::RadixDictionary(RadixDictionary&& other)
+    : root(other.root), count(other.count) { // Transfer ownership of the trie
+    other.root = nullptr;
+    other.count = 0;
+}
+
+RadixDictionary& RadixDictionary::operator=(const RadixDictionary& other) {
+    if (this != &other) {
+        Level3* copy = other.root != nullptr ? copyWorker(other.root) : nullptr;
+        if (root != nullptr) {
+            deleteWorker(root);
+        }
+        root = copy;
+        count = other.count;
+    }
+    return *this;
+}
+
+RadixDictionary& RadixDictionary::operator=(RadixDictionary&& other) {
+    if (this != &other) {
+        if (root != nullptr) {
+            deleteWorker(root);
+        }
+        root = other.root;
+        count = other.count;
+        other.root = nullptr;
+        other.count = 0;
+    }
+    return *this;
+}
+
+// Byte 'byte' (3 = most significant) of the key with its sign bit flipped,
+// so unsigned byte order matches signed key order.
+unsigned RadixDictionary::keyByte(int key, int byte) {
+    std::uint32_t biased = static_cast<std::uint32_t>(key) ^ 0x80000000u;
+    return (biased >> (8 * byte)) & 0xFF;
+}
+
+int RadixDictionary::keyFromPrefix(std::uint32_t prefix) {
+    return static_cast<std::int32_t>(prefix ^ 0x80000000u);
+}
+
+bool RadixDictionary::Bitmap::test(unsigned i) const {
+    return (words[i / 64] >> (i % 64)) & 1;
+}
+
+void RadixDictionary::Bitmap::set(unsigned i) {
+    words[i / 64] |= std::uint64_t(1) << (i % 64);
+}
+
+void RadixDictionary::Bitmap::clear(unsigned i) {
+    words[i / 64] &= ~(std::uint64_t(1) << (i % 64));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Add a key-item pair, creating the nodes along its path as needed.
+void RadixDictionary::insert(int key, const std::string& item) {
+    if (root == nullptr) {
+        root = new Level3(); // Value-initialised: empty bitmap, null children
+    }
+    insertWorker(root, key, 3, item);
+}
+
+template <typename Child>
+void RadixDictionary::insertWorker(Inner<Child>* node, int key, int byte, const std::string& item) {
+    unsigned i = keyByte(key, byte);
+    if (!node->present.test(i)) {
+        node->children[i] = new Child();
+        node->present.set(i);
+        ++node->count;
+    }
+    insertWorker(node->children[i], key, byte - 1, item);
+}
+
+void RadixDictionary::insertWorker(Leaf* leaf, int key, int byte, const std::string& item) {
+    unsigned i = keyByte(key, byte);
+    if (!leaf->present.test(i)) {
+        leaf->present.set(i);
+        ++leaf->count;
+        ++count;
+    }
+    leaf->items[i] = item; // Overwrites an existing item
+}
+
+std::size_t RadixDictionary::size() const {
+    return count;
+}
+
+std::string* RadixDictionary::lookup(int key) {
+    return root != nullptr ? lookupWorker(root, key, 3) : nullptr;
+}
+
+template <typename Child>
+std::string* RadixDictionary::lookupWorker(Inner<Child>* node, int key, int byte) {
+    unsigned i = keyByte(key, byte);
+    if (!node->present.test(i)) {
+        return nullptr;
+    }
+    return lookupWorker(node->children[i], key, byte - 1);
+}
+
+std::string* RadixDictionary::lookupWorker(Leaf* leaf, int key, int byte) {
+    unsigned i = keyByte(key, byte);
+    return leaf->present.test(i) ? &leaf->items[i] : nullptr;
+}
+
+// Remove a key, freeing any node the removal leaves empty.
+void RadixDictionary::remove(int key) {
+    if (root != nullptr && removeWorker(root, key, 3)) {
+        delete root;
+        root = nullptr;
+    }
+}
+
+template <typename Child>
+bool RadixDictionary::removeWorker(Inner<Child>* node, int key, int byte) {
+    unsigned i = keyByte(key, byte);
+    if (node->present.test(i) && removeWorker(node->children[i], key, byte - 1)) {
+        dropChild(node, i);
+    }
+    return node->count == 0;
+}
+
+bool RadixDictionary::removeWorker(Leaf* leaf, int key, int byte) {
+    unsigned i = keyByte(key, byte);
+    if (leaf->present.test(i)) {
+        leaf->present.clear(i);
+        leaf->items[i].clear();
+        leaf->items[i].shrink_to_fit();
+        --leaf->count;
+        --count;
+    }
+    return leaf->count == 0;
+}
+
+template <typename Child>
+void RadixDictionary::dropChild(Inner<Child>* node, unsigned i) {
+    delete node->children[i];
+    node->children[i] = nullptr;
+    node->present.clear(i);
+    --node->count;
+}
+
+// Single in-order pass that drops matching entries in place.
+void RadixDictionary::removeIf(std::function<bool(int)> predicate) {
+    removeIf([&](int key, const std::string&) { return predicate(key); });
+}
+
+// If the predicate throws, the entries already dropped stay dropped, and
+// every node they emptied is freed on the way out.
+void RadixDictionary::removeIf(std::function<bool(int, const std::string&)> predicate) {
+    if (root == nullptr) {
+        return;
+    }
+    bool empty;
+    try {
+        empty = removeIfWorker(root, 0, predicate);
+    }
+    catch (...) {
+        if (root->count == 0) {
+            delete root;
+            root = nullptr;
+        }
+        throw;
+    }
+    if (empty) {
+        delete root;
+        root = nullptr;
+    }
+}
+
+template <typename Child>
+bool RadixDictionary::removeIfWorker(Inner<Child>* node, std::uint32_t prefix, const std::function<bool(int, const std::string&)>& predicate) {
+    for (unsigned i = 0; i < fanout; ++i) {
+        if (!node->present.test(i)) {
+            continue;
+        }
+        bool empty;
+        try {
+            empty = removeIfWorker(node->children[i], (prefix << 8) | i, predicate);
+        }
+        catch (...) {
+            if (node->children[i]->count == 0) {
+                dropChild(node, i);
+            }
+            throw;
+        }
+        if (empty) {
+            dropChild(node, i);
+        }
+    }
+    return node->count == 0;
+}
+
+bool RadixDictionary::removeIfWorker(Leaf* leaf, std::uint32_t prefix, const std::function<bool(int, const std::string&)>& predicate) {
+    for (unsigned i = 0; i < fanout; ++i) {
+        if (leaf->present.test(i) && predicate(keyFromPrefix((prefix << 8) | i), leaf->items[i])) {
+            leaf->present.clear(i);
+            leaf->items[i].clear();
+            leaf->items[i].shrink_to_fit();
+            --leaf->count;
+            --count;
+        }
+    }
+    return leaf->count == 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void RadixDictionary::deleteWorker(Leaf* leaf) {
+    delete leaf;
+}
+
+template <typename Child>
+void RadixDictionary::deleteWorker(Inner<Child>* node) {
+    for (unsigned i = 0; i < fanout; ++i) {
+        if (node->present.test(i)) {
+            deleteWorker(node->children[i]);
+        }
+    }
+    delete node;
+}
+
+RadixDictionary::Leaf* RadixDictionary::copyWorker(const Leaf* leaf) {
+    return new Leaf(*leaf);
+}
+
+template <typename Child>
+RadixDictionary::Inner<Child>* RadixDictionary::copyWorker(const Inner<Child>* node) {
+    Inner<Child>* copy = new Inner<Child>();
+    copy->present = node->present;
+    copy->count = node->count;
+    for (unsigned i = 0; i < fanout; ++i) {
+        if (node->present.test(i)) {
+            copy->children[i] = copyWorker(node->children[i]);
+        }
+    }
+    return copy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Display all entries in key order.
+void RadixDictionary::displayEntries() {
+    if (root != nullptr) {
+        displayWorker(root, 0, -1, false);
+    }
+}
+
+// Display the trie, one indented line per node labelled with its key prefix.
+void RadixDictionary::displayTree() {
+    if (root != nullptr) {
+        displayWorker(root, 0, 0, true);
+    }
+}
+
+template <typename Child>
+void RadixDictionary::displayWorker(const Inner<Child>* node, std::uint32_t prefix, int depth, bool tree) {
+    for (unsigned i = 0; i < fanout; ++i) {
+        if (!node->present.test(i)) {
+            continue;
+        }
+        if (tree) {
+            printIndent(depth);
+            std::cout << "Byte: " << i << ", Children: " << node->children[i]->count << std::endl;
+        }
+        displayWorker(node->children[i], (prefix << 8) | i, tree ? depth + 1 : depth, tree);
+    }
+}
+
+void RadixDictionary::displayWorker(const Leaf* leaf, std::uint32_t prefix, int depth, bool tree) {
+    for (unsigned i = 0; i < fanout; ++i) {
+        if (leaf->present.test(i)) {
+            if (tree) {
+                printIndent(depth);
+            }
+            std::cout << "Key: " << keyFromPrefix((prefix << 8) | i) << ", Item: " << leaf->items[i] << std::endl;
+        }
+    }
+}
+
+void RadixDictionary::printIndent(int depth) {
+    for (int i = 0; i < depth; ++i) {
+        std::cout << "  "; // Two spaces for each level of depth
+    }
+}
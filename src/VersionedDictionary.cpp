@@ -0,0 +1,309 @@
+#include "VersionedDictionary.h"
+#include <stdexcept>
+
+// Epoch-based reclamation in brief: a reader announces the global epoch in a
+// slot before loading the current version. A writer retires the nodes it
+// replaced tagged with the epoch at that time, then advances the epoch. A
+// retired node is freed once its tag is older than every announced epoch,
+// since any reader that could have loaded it announced an epoch <= its tag.
+// All atomics use sequentially consistent ordering for this argument to hold.
+
+VersionedDictionary::VersionedDictionary()
+    : current(new Version{ nullptr, 0, 0 }), latestSize(0), epoch(1), reclaimedCount(0) {
+    for (std::atomic<std::uint64_t>& slot : readerEpochs) {
+        slot.store(0);
+    }
+}
+
+VersionedDictionary::~VersionedDictionary() {
+    const Version* latest = current.load();
+    deleteWorker(latest->root);
+    delete latest;
+    for (const auto& retired : retiredNodes) {
+        delete retired.second;
+    }
+    for (const auto& retired : retiredVersions) {
+        delete retired.second;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Writers
+
+void VersionedDictionary::insert(int key, const std::string& item) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    const Version* latest = current.load();
+    bool added = false;
+    const Node* root = insertWorker(latest->root, key, item, added);
+    publish(root, latest->size + (added ? 1 : 0));
+}
+
+void VersionedDictionary::remove(int key) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    const Version* latest = current.load();
+    bool removed = false;
+    const Node* root = removeWorker(latest->root, key, removed);
+    if (removed) {
+        publish(root, latest->size - 1);
+    }
+}
+
+// Each matching key is removed as its own version.
+void VersionedDictionary::removeIf(std::function<bool(int)> predicate) {
+    std::vector<int> keysToRemove;
+    {
+        Snapshot view = snapshot();
+        view.forEach([&](int key, const std::string&) {
+            if (predicate(key)) {
+                keysToRemove.push_back(key);
+            }
+        });
+    }
+    for (int key : keysToRemove) {
+        remove(key);
+    }
+}
+
+// Copy the path to the key; the replaced nodes are retired.
+const VersionedDictionary::Node* VersionedDictionary::insertWorker(const Node* node, int key, const std::string& item, bool& added) {
+    if (node == nullptr) {
+        added = true;
+        return new Node(key, item, nullptr, nullptr);
+    }
+
+    const Node* copy;
+    if (key < node->key) {
+        copy = new Node(node->key, node->item, insertWorker(node->left, key, item, added), node->right);
+    }
+    else if (key > node->key) {
+        copy = new Node(node->key, node->item, node->left, insertWorker(node->right, key, item, added));
+    }
+    else {
+        copy = new Node(key, item, node->left, node->right); // Overwrite
+    }
+    retire(node);
+    return copy;
+}
+
+const VersionedDictionary::Node* VersionedDictionary::removeWorker(const Node* node, int key, bool& removed) {
+    if (node == nullptr) {
+        return nullptr; // Key not found; nothing on the path is copied
+    }
+
+    if (key < node->key) {
+        const Node* left = removeWorker(node->left, key, removed);
+        if (!removed) {
+            return node;
+        }
+        retire(node);
+        return new Node(node->key, node->item, left, node->right);
+    }
+    if (key > node->key) {
+        const Node* right = removeWorker(node->right, key, removed);
+        if (!removed) {
+            return node;
+        }
+        retire(node);
+        return new Node(node->key, node->item, node->left, right);
+    }
+
+    removed = true;
+    retire(node);
+    if (node->left == nullptr || node->right == nullptr) {
+        return node->left != nullptr ? node->left : node->right;
+    }
+    // Two children: the in-order successor takes the node's place.
+    const Node* successor;
+    const Node* right = removeMinWorker(node->right, successor);
+    const Node* replacement = new Node(successor->key, successor->item, node->left, right);
+    retire(successor);
+    return replacement;
+}
+
+// Copy the path to the minimum of a non-empty subtree, leaving it out.
+const VersionedDictionary::Node* VersionedDictionary::removeMinWorker(const Node* node, const Node*& minNode) {
+    if (node->left == nullptr) {
+        minNode = node;
+        return node->right;
+    }
+    const Node* copy = new Node(node->key, node->item, removeMinWorker(node->left, minNode), node->right);
+    retire(node);
+    return copy;
+}
+
+// Make a new version current, then advance the epoch and reclaim what we can.
+// The previous version may be freed here, so unpinned readers such as size()
+// must not dereference current.
+void VersionedDictionary::publish(const Node* root, std::size_t size) {
+    const Version* previous = current.load();
+    current.store(new Version{ root, size, previous->number + 1 });
+    latestSize.store(size);
+    retiredVersions.emplace_back(epoch.load(), previous);
+    epoch.fetch_add(1);
+    reclaimLocked();
+}
+
+void VersionedDictionary::retire(const Node* node) {
+    retiredNodes.emplace_back(epoch.load(), node);
+}
+
+void VersionedDictionary::reclaim() {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    reclaimLocked();
+}
+
+void VersionedDictionary::reclaimLocked() {
+    std::uint64_t oldestPinned = epoch.load();
+    for (const std::atomic<std::uint64_t>& slot : readerEpochs) {
+        std::uint64_t pinned = slot.load();
+        if (pinned != 0 && pinned < oldestPinned) {
+            oldestPinned = pinned;
+        }
+    }
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < retiredNodes.size(); ++i) {
+        if (retiredNodes[i].first < oldestPinned) {
+            delete retiredNodes[i].second;
+            ++reclaimedCount;
+        }
+        else {
+            retiredNodes[kept++] = retiredNodes[i];
+        }
+    }
+    retiredNodes.resize(kept);
+
+    kept = 0;
+    for (std::size_t i = 0; i < retiredVersions.size(); ++i) {
+        if (retiredVersions[i].first < oldestPinned) {
+            delete retiredVersions[i].second;
+        }
+        else {
+            retiredVersions[kept++] = retiredVersions[i];
+        }
+    }
+    retiredVersions.resize(kept);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Readers
+
+// Claim a reader slot announcing the current epoch.
+std::size_t VersionedDictionary::pin() const {
+    for (std::size_t i = 0; i < maxSnapshots; ++i) {
+        std::uint64_t expected = 0;
+        if (readerEpochs[i].load() == 0 && readerEpochs[i].compare_exchange_strong(expected, epoch.load())) {
+            return i;
+        }
+    }
+    throw std::runtime_error("VersionedDictionary: too many open snapshots");
+}
+
+void VersionedDictionary::unpin(std::size_t slot) const {
+    readerEpochs[slot].store(0);
+}
+
+VersionedDictionary::Snapshot VersionedDictionary::snapshot() const {
+    std::size_t slot = pin();
+    return Snapshot(this, slot, current.load()); // Loaded only after pinning
+}
+
+bool VersionedDictionary::lookup(int key, std::string& item) const {
+    Snapshot view = snapshot();
+    const std::string* found = view.lookup(key);
+    if (found != nullptr) {
+        item = *found;
+    }
+    return found != nullptr;
+}
+
+std::size_t VersionedDictionary::size() const {
+    return latestSize.load();
+}
+
+VersionedDictionary::GcStats VersionedDictionary::gcStats() const {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    std::size_t active = 0;
+    for (const std::atomic<std::uint64_t>& slot : readerEpochs) {
+        if (slot.load() != 0) {
+            ++active;
+        }
+    }
+    return GcStats{ current.load()->number, retiredNodes.size(), reclaimedCount, active };
+}
+
+const VersionedDictionary::Node* VersionedDictionary::lookupWorker(const Node* node, int key) {
+    while (node != nullptr && node->key != key) {
+        node = key < node->key ? node->left : node->right;
+    }
+    return node;
+}
+
+void VersionedDictionary::forEachWorker(const Node* node, const std::function<void(int, const std::string&)>& visit) {
+    if (node != nullptr) {
+        forEachWorker(node->left, visit);
+        visit(node->key, node->item);
+        forEachWorker(node->right, visit);
+    }
+}
+
+void VersionedDictionary::deleteWorker(const Node* node) {
+    if (node != nullptr) {
+        deleteWorker(node->left);
+        deleteWorker(node->right);
+        delete node;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Snapshot
+
+VersionedDictionary::Snapshot::Snapshot(const VersionedDictionary* owner, std::size_t slot, const Version* state)
+    : owner(owner), slot(slot), state(state) {}
+
+VersionedDictionary::Snapshot::Snapshot(Snapshot&& other)
+    : owner(other.owner), slot(other.slot), state(other.state) {
+    other.owner = nullptr;
+}
+
+VersionedDictionary::Snapshot& VersionedDictionary::Snapshot::operator=(Snapshot&& other) {
+    if (this != &other) {
+        close();
+        owner = other.owner;
+        slot = other.slot;
+        state = other.state;
+        other.owner = nullptr;
+    }
+    return *this;
+}
+
+VersionedDictionary::Snapshot::~Snapshot() {
+    close();
+}
+
+void VersionedDictionary::Snapshot::close() {
+    if (owner != nullptr) {
+        owner->unpin(slot);
+        owner = nullptr;
+    }
+}
+
+const std::string* VersionedDictionary::Snapshot::lookup(int key) const {
+    const Node* node = lookupWorker(state->root, key);
+    return node != nullptr ? &node->item : nullptr;
+}
+
+void VersionedDictionary::Snapshot::forEach(const std::function<void(int, const std::string&)>& visit) const {
+    forEachWorker(state->root, visit);
+}
+
+std::size_t VersionedDictionary::Snapshot::size() const {
+    return state->size;
+}
+
+std::uint64_t VersionedDictionary::Snapshot::version() const {
+    return state->number;
+}